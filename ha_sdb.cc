@@ -20,10 +20,14 @@
 #include "ha_sdb.h"
 #include <sql_class.h>
 #include <sql_table.h>
+#include <key.h>
+#include <binlog.h>
+#include <sql_insert.h>
 #include <mysql/plugin.h>
 #include <mysql/psi/mysql_file.h>
 #include <json_dom.h>
 #include <time.h>
+#include <my_atomic.h>
 #include <client.hpp>
 #include "sdb_log.h"
 #include "sdb_conf.h"
@@ -34,6 +38,7 @@
 #include "sdb_condition.h"
 #include "sdb_errcode.h"
 #include "sdb_idx.h"
+#include "sdb_seq.h"
 
 using namespace sdbclient;
 
@@ -65,11 +70,8 @@ using namespace sdbclient;
   ", BuildTime: " __DATE__ " " __TIME__
 
 #define SDB_OID_LEN 12
-#define SDB_OID_FIELD "_id"
 #define SDB_FIELD_MAX_LEN (16 * 1024 * 1024)
 
-#define SDB_COMMENT "sequoiadb"
-
 const static char *sdb_plugin_info = SDB_ENGINE_INFO ". " SDB_VERSION_INFO ".";
 
 handlerton *sdb_hton = NULL;
@@ -99,6 +101,39 @@ static const Alter_inplace_info::HA_ALTER_FLAGS INPLACE_ONLINE_OPERATIONS =
     Alter_inplace_info::ALTER_COLUMN_EQUAL_PACK_LENGTH |
     Alter_inplace_info::CHANGE_CREATE_OPTION | Alter_inplace_info::RENAME_INDEX;
 
+#ifdef QUERY_FOR_SHARE
+#define SDB_QUERY_FOR_SHARE QUERY_FOR_SHARE
+#else
+// The driver can't take shared locks, exclusive ones are taken instead.
+#define SDB_QUERY_FOR_SHARE QUERY_FOR_UPDATE
+#endif
+
+/*
+  SequoiaDB has no snapshot read, so REPEATABLE READ, the default, is mapped
+  to read committed. Read stability locks every row read till the end of
+  transaction, which is only taken for SERIALIZABLE.
+*/
+static uint sdb_tx_isolation(THD *thd) {
+  switch (thd_tx_isolation(thd)) {
+    case ISO_READ_UNCOMMITTED:
+      return SDB_TRANS_ISO_RU;
+    case ISO_SERIALIZABLE:
+      return SDB_TRANS_ISO_RS;
+    default:
+      return SDB_TRANS_ISO_RC;
+  }
+}
+
+/*
+  Whether the rows changed by current statement are written to a row-based
+  binlog by the SQL layer.
+*/
+static inline bool sdb_is_row_binlogged(THD *thd) {
+  return mysql_bin_log.is_open() &&
+         (thd->variables.option_bits & OPTION_BIN_LOG) &&
+         thd->is_current_stmt_binlog_format_row();
+}
+
 static uchar *sdb_get_key(Sdb_share *share, size_t *length,
                           my_bool not_used MY_ATTRIBUTE((unused))) {
   *length = share->table_name_length;
@@ -155,6 +190,7 @@ static int free_sdb_share(Sdb_share *share) {
   if (!--share->use_count) {
     my_hash_delete(&sdb_open_tables, (uchar *)share);
     thr_lock_delete(&share->lock);
+    delete share->sharding_key;
     my_free(share);
   }
   mysql_mutex_unlock(&sdb_mutex);
@@ -172,14 +208,36 @@ ha_sdb::ha_sdb(handlerton *hton, TABLE_SHARE *table_arg)
   count_times = 0;
   last_count_time = time(NULL);
   m_use_bulk_insert = false;
+  m_use_async_bulk_insert = false;
+  m_bulk_insert_bytes = 0;
+  m_async_insert_bytes = 0;
+  m_bulk_insert_ctrl = NULL;
+  m_insert_arena_idx = 0;
+  m_use_bulk_delete = false;
+  m_use_bulk_update = false;
+  m_dup_key_nr = (uint)-1;
+  m_write_can_replace = false;
+  m_insert_with_update = false;
+  m_upsert_key = MAX_KEY;
+  m_datetime_as_int64 = false;
+  m_lob_threshold = 0;
+  m_use_lob = false;
+  m_pinned_row_idx = 0;
+  m_use_read_removal = false;
+  m_read_removal_row = false;
+  m_read_removal_rows = 0;
+  m_semi_consistent_read = false;
+  m_did_semi_consistent_read = false;
   stats.records = 0;
   memset(db_name, 0, SDB_CS_NAME_MAX_SIZE + 1);
   memset(table_name, 0, SDB_CL_NAME_MAX_SIZE + 1);
   init_alloc_root(sdb_key_memory_blobroot, &blobroot, 8 * 1024, 0);
+  init_alloc_root(sdb_key_memory_blobroot, &m_lob_root, 8 * 1024, 0);
 }
 
 ha_sdb::~ha_sdb() {
   free_root(&blobroot, MYF(0));
+  free_root(&m_lob_root, MYF(0));
   if (NULL != collection) {
     delete collection;
     collection = NULL;
@@ -200,9 +258,21 @@ const char **ha_sdb::bas_ext() const {
 }
 
 ulonglong ha_sdb::table_flags() const {
-  return (HA_REC_NOT_IN_SEQ | HA_NO_AUTO_INCREMENT | HA_NO_READ_LOCAL_LOCK |
-          HA_BINLOG_ROW_CAPABLE | HA_BINLOG_STMT_CAPABLE |
-          HA_TABLE_SCAN_ON_INDEX | HA_NULL_IN_KEY | HA_CAN_INDEX_BLOBS);
+  ulonglong flags =
+      (HA_REC_NOT_IN_SEQ | HA_NO_READ_LOCAL_LOCK | HA_BINLOG_ROW_CAPABLE |
+       HA_BINLOG_STMT_CAPABLE |
+       HA_TABLE_SCAN_ON_INDEX | HA_NULL_IN_KEY | HA_CAN_INDEX_BLOBS |
+       HA_READ_BEFORE_WRITE_REMOVAL);
+  /*
+    With read removal, the old row only contains the key fields, so the SQL
+    layer must not compare it with the new row to skip the write.
+    HA_PARTIAL_COLUMN_READ makes it compare only when all the written
+    columns have been read.
+  */
+  if (m_use_read_removal) {
+    flags |= HA_PARTIAL_COLUMN_READ;
+  }
+  return flags;
 }
 
 ulong ha_sdb::index_flags(uint inx, uint part, bool all_parts) const {
@@ -273,6 +343,31 @@ int ha_sdb::open(const char *name, int mode, uint test_if_locked) {
     goto error;
   }
 
+  load_sharding_key(connection);
+
+  m_datetime_as_int64 = sdb_is_datetime_as_int64(table->s->comment.str);
+
+  m_lob_threshold = sdb_get_lob_threshold(table->s->comment.str);
+  m_use_lob = false;
+  for (Field **fields = table->field; *fields && m_lob_threshold > 0;
+       fields++) {
+    if (MYSQL_TYPE_BLOB == (*fields)->type() &&
+        !((*fields)->flags & PART_KEY_FLAG)) {
+      m_use_lob = true;
+      break;
+    }
+  }
+
+  rc = m_row_encoder.init(table, m_datetime_as_int64);
+  if (0 != rc) {
+    goto error;
+  }
+
+  rc = m_row_decoder.init(table, m_datetime_as_int64);
+  if (0 != rc) {
+    goto error;
+  }
+
   thr_lock_data_init(&share->lock, &lock_data, (void *)this);
 
   ref_length = SDB_OID_LEN;  // length of _id
@@ -309,6 +404,19 @@ int ha_sdb::close(void) {
     share = NULL;
   }
   m_bulk_insert_rows.clear();
+  m_bulk_replace_conds.clear();
+  m_bulk_replace_keys.clear();
+  m_insert_arena[0].release();
+  m_insert_arena[1].release();
+  m_row_encoder.release();
+  m_row_decoder.release();
+  m_conv_str.free();
+  m_created_lobs.clear();
+  m_bulk_insert_lobs[0].clear();
+  m_bulk_insert_lobs[1].clear();
+  release_pinned_rows();
+  m_bulk_delete_oids.clear();
+  m_bulk_update_oids.clear();
   m_bson_element_cache.release();
   return 0;
 }
@@ -320,9 +428,40 @@ int ha_sdb::reset() {
   }
   // don't release bson element cache, so that we can reuse it
   m_bulk_insert_rows.clear();
+  m_bulk_insert_lobs[0].clear();
+  m_bulk_insert_lobs[1].clear();
+  m_bulk_replace_conds.clear();
+  m_bulk_replace_keys.clear();
+  m_insert_arena[0].reset();
+  m_insert_arena[1].reset();
+  m_use_async_bulk_insert = false;
+  // Left by a failed statement, which didn't end bulk insert.
+  if (m_bulk_insert_ctrl && m_bulk_insert_bytes + m_async_insert_bytes > 0) {
+    m_bulk_insert_ctrl->release(m_bulk_insert_bytes + m_async_insert_bytes);
+  }
+  m_bulk_insert_bytes = 0;
+  m_async_insert_bytes = 0;
+  m_write_can_replace = false;
+  m_insert_with_update = false;
+  m_use_bulk_delete = false;
+  m_bulk_delete_oids.clear();
+  m_use_bulk_update = false;
+  m_bulk_update_oids.clear();
+  m_bulk_update_rule = SDB_EMPTY_BSON;
+  m_dup_key_nr = (uint)-1;
   free_root(&blobroot, MYF(0));
+  free_root(&m_lob_root, MYF(0));
+  release_pinned_rows();
   m_lock_type = TL_IGNORE;
   pushed_condition = SDB_EMPTY_BSON;
+  if (m_use_read_removal) {
+    // end_read_removal() is skipped when the statement fails.
+    m_use_read_removal = false;
+    cached_table_flags = table_flags();
+  }
+  m_read_removal_row = false;
+  m_semi_consistent_read = false;
+  m_did_semi_consistent_read = false;
   return 0;
 }
 
@@ -368,6 +507,80 @@ error:
   goto done;
 }
 
+/*
+  Encode the row to insert into the arena with the encoding plan of table.
+  It's the same as row_to_obj(buf, obj, TRUE, FALSE, ...), except that only
+  the fields without a specialized encoder go through field_to_obj().
+*/
+int ha_sdb::encode_row(uchar *buf, Sdb_bson_arena &arena,
+                       bson::BSONObj &obj) {
+  int rc = 0;
+  bool pad_char = ha_thd()->variables.sql_mode & MODE_PAD_CHAR_TO_FULL_LENGTH;
+  bson::OID oid = bson::OID::gen();
+  char *oid_ptr = NULL;
+
+  DBUG_ASSERT(m_row_encoder.field_count() == table->s->fields);
+
+  my_bitmap_map *org_bitmap = dbug_tmp_use_all_columns(table, table->read_set);
+  if (buf != table->record[0]) {
+    repoint_field_to_record(table, table->record[0], buf);
+  }
+
+  rc = arena.begin_obj();
+  if (0 != rc) {
+    goto error;
+  }
+
+  // _id should be the first element for good performance.
+  oid_ptr = arena.append_element(bson::jstOID, SDB_OID_FIELD,
+                                 sizeof(SDB_OID_FIELD) - 1, sizeof(oid));
+  if (NULL == oid_ptr) {
+    rc = HA_ERR_OUT_OF_MEM;
+    goto error;
+  }
+  memcpy(oid_ptr, &oid, sizeof(oid));
+
+  for (uint i = 0; i < m_row_encoder.field_count(); ++i) {
+    const Sdb_field_encoder &encoder = m_row_encoder[i];
+    if (encoder.null_bit && (buf[encoder.null_offset] & encoder.null_bit)) {
+      continue;
+    }
+
+    rc = SDB_ERR_TYPE_UNSUPPORTED;
+    if (encoder.encode && !(encoder.pad_sensitive && pad_char) &&
+        !is_lob_field(table->field[i])) {
+      rc = encoder.encode(arena, encoder, buf + encoder.offset);
+    }
+    if (SDB_ERR_TYPE_UNSUPPORTED == rc) {
+      bson::BSONObjBuilder builder;
+      bson::BSONObj field_obj;
+      rc = field_to_obj(table->field[i], builder);
+      if (0 != rc) {
+        goto error;
+      }
+      field_obj = builder.done();
+      if (!field_obj.isEmpty()) {
+        bson::BSONElement elem = field_obj.firstElement();
+        rc = arena.append_raw(elem.rawdata(), elem.size());
+      }
+    }
+    if (0 != rc) {
+      goto error;
+    }
+  }
+
+  rc = arena.end_obj(obj);
+
+done:
+  if (buf != table->record[0]) {
+    repoint_field_to_record(table, buf, table->record[0]);
+  }
+  dbug_tmp_restore_column_map(table->read_set, org_bitmap);
+  return rc;
+error:
+  goto done;
+}
+
 int ha_sdb::field_to_obj(Field *field, bson::BSONObjBuilder &obj_builder) {
   int rc = 0;
 
@@ -400,11 +613,13 @@ int ha_sdb::field_to_obj(Field *field, bson::BSONObjBuilder &obj_builder) {
       if (value < 0 && ((Field_num *)field)->unsigned_flag) {
         // overflow, so store as DECIMAL
         my_decimal tmp_val;
-        char buff[MAX_FIELD_WIDTH];
-        String str(buff, sizeof(buff), field->charset());
-        ((Field_num *)field)->val_decimal(&tmp_val);
-        my_decimal2string(E_DEC_FATAL_ERROR, &tmp_val, 0, 0, 0, &str);
-        obj_builder.appendDecimal(field->field_name, str.c_ptr());
+        bson::bsonDecimal decimal_val;
+        ulonglong2decimal((ulonglong)value, &tmp_val);
+        rc = sdb_decimal_to_bson(&tmp_val, decimal_val);
+        if (0 != rc) {
+          goto error;
+        }
+        obj_builder.append(field->field_name, decimal_val);
       } else {
         obj_builder.append(field->field_name, (long long)value);
       }
@@ -424,21 +639,28 @@ int ha_sdb::field_to_obj(Field *field, bson::BSONObjBuilder &obj_builder) {
     case MYSQL_TYPE_LONG_BLOB:
     case MYSQL_TYPE_BLOB: {
       String val_tmp;
+      String *str = &val_tmp;
+      bool binary = ((Field_str *)field)->binary();
       field->val_str(&val_tmp);
-      if (((Field_str *)field)->binary()) {
-        obj_builder.appendBinData(field->field_name, val_tmp.length(),
-                                  bson::BinDataGeneral, val_tmp.ptr());
-      } else {
-        String conv_str;
-        String *str = &val_tmp;
-        if (!my_charset_same(str->charset(), &SDB_CHARSET)) {
-          rc = sdb_convert_charset(*str, conv_str, &SDB_CHARSET);
-          if (rc) {
-            goto error;
-          }
-          str = &conv_str;
+      if (!binary && !sdb_is_same_in_charset(str->ptr(), str->length(),
+                                             str->charset(), &SDB_CHARSET)) {
+        // convert into the buffer kept by handler, to avoid allocation
+        rc = sdb_convert_charset(*str, m_conv_str, &SDB_CHARSET);
+        if (rc) {
+          goto error;
         }
+        str = &m_conv_str;
+      }
 
+      if (is_lob_field(field) && str->length() >= m_lob_threshold) {
+        rc = append_lob(field, *str, obj_builder);
+        if (rc) {
+          goto error;
+        }
+      } else if (binary) {
+        obj_builder.appendBinData(field->field_name, str->length(),
+                                  bson::BinDataGeneral, str->ptr());
+      } else {
         obj_builder.appendStrWithNoTerminating(field->field_name, str->ptr(),
                                                str->length());
       }
@@ -453,6 +675,15 @@ int ha_sdb::field_to_obj(Field *field, bson::BSONObjBuilder &obj_builder) {
         rc = -1;
         goto error;
       }
+      if (MYSQL_TYPE_NEWDECIMAL == field->real_type()) {
+        my_decimal tmp_val;
+        bson::bsonDecimal decimal_val;
+        if (0 == sdb_decimal_to_bson(field->val_decimal(&tmp_val),
+                                     decimal_val)) {
+          obj_builder.append(field->field_name, decimal_val);
+          break;
+        }
+      }
       char buff[MAX_FIELD_WIDTH];
       String str(buff, sizeof(buff), field->charset());
       String unused;
@@ -463,19 +694,9 @@ int ha_sdb::field_to_obj(Field *field, bson::BSONObjBuilder &obj_builder) {
     case MYSQL_TYPE_DATE: {
       longlong date_val = 0;
       date_val = ((Field_newdate *)field)->val_int();
-      struct tm tm_val;
-      tm_val.tm_sec = 0;
-      tm_val.tm_min = 0;
-      tm_val.tm_hour = 0;
-      tm_val.tm_mday = date_val % 100;
-      date_val = date_val / 100;
-      tm_val.tm_mon = date_val % 100 - 1;
-      date_val = date_val / 100;
-      tm_val.tm_year = date_val - 1900;
-      tm_val.tm_wday = 0;
-      tm_val.tm_yday = 0;
-      tm_val.tm_isdst = 0;
-      time_t time_tmp = mktime(&tm_val);
+      time_t time_tmp = sdb_mktime_date(
+          (uint)(date_val / 10000), (uint)(date_val / 100 % 100),
+          (uint)(date_val % 100));
       bson::Date_t dt((longlong)(time_tmp * 1000));
       obj_builder.appendDate(field->field_name, dt);
       break;
@@ -493,6 +714,11 @@ int ha_sdb::field_to_obj(Field *field, bson::BSONObjBuilder &obj_builder) {
       // skip the null value
       break;
     case MYSQL_TYPE_DATETIME: {
+      if (m_datetime_as_int64) {
+        obj_builder.append(field->field_name,
+                           (long long)field->val_date_temporal());
+        break;
+      }
       char buff[MAX_FIELD_WIDTH];
       String str(buff, sizeof(buff), field->charset());
       field->val_str(&str);
@@ -502,12 +728,27 @@ int ha_sdb::field_to_obj(Field *field, bson::BSONObjBuilder &obj_builder) {
     case MYSQL_TYPE_JSON: {
       Json_wrapper wr;
       String buf;
+      bson::BSONObjBuilder json_builder;
       Field_json *field_json = dynamic_cast<Field_json *>(field);
 
+      if (field_json->val_json(&wr)) {
+        my_error(ER_INVALID_JSON_BINARY_DATA, MYF(0));
+        rc = ER_INVALID_JSON_BINARY_DATA;
+        goto error;
+      }
+
+      // Native BSON can be filtered by path in SequoiaDB. JSON null can't,
+      // for it would be read as SQL NULL.
+      if (J_NULL != wr.type() &&
+          0 == sdb_json_to_bson(wr, field->field_name, json_builder)) {
+        obj_builder.appendElements(json_builder.done());
+        break;
+      }
+
 #if MYSQL_VERSION_ID >= 50722
-      if (field_json->val_json(&wr) || wr.to_binary(&buf)) {
+      if (wr.to_binary(&buf)) {
 #else
-      if (field_json->val_json(&wr) || wr.to_value().raw_binary(&buf)) {
+      if (wr.to_value().raw_binary(&buf)) {
 #endif
         my_error(ER_INVALID_JSON_BINARY_DATA, MYF(0));
         rc = ER_INVALID_JSON_BINARY_DATA;
@@ -532,6 +773,129 @@ error:
   goto done;
 }
 
+/*
+  BLOB and TEXT of the table with lob_threshold may be stored in LOBs, and
+  the record keeps only the OID of LOB. The fields of keys are not, because
+  the index lookups on them are matched by value. Conditions on the others
+  are never pushed down, see Sdb_cond_ctx::push().
+*/
+bool ha_sdb::is_lob_field(Field *field) {
+  return m_use_lob && MYSQL_TYPE_BLOB == field->type() &&
+         !(field->flags & PART_KEY_FLAG);
+}
+
+int ha_sdb::append_lob(Field *field, const String &str,
+                       bson::BSONObjBuilder &obj_builder) {
+  int rc = 0;
+  bson::OID oid;
+  Sdb_conn *conn = NULL;
+
+  DBUG_ASSERT(NULL != collection);
+
+  conn = check_sdb_in_thd(ha_thd(), true);
+  if (NULL == conn) {
+    rc = HA_ERR_NO_CONNECTION;
+    goto error;
+  }
+
+  rc = collection->create_lob(str.ptr(), str.length(), oid);
+  if (rc != 0) {
+    goto error;
+  }
+  conn->add_created_lob(db_name, table_name, oid);
+  m_created_lobs.push_back(oid);
+
+  obj_builder.appendOID(field->field_name, &oid);
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+/*
+  Fetch the value stored in LOB into m_lob_root. The data is in SDB_CHARSET
+  like the string in record.
+*/
+int ha_sdb::read_lob(const bson::BSONElement &elem, Field *field) {
+  int rc = 0;
+  Field_blob *blob = (Field_blob *)field;
+  char *data = NULL;
+  size_t size = 0;
+
+  DBUG_ASSERT(NULL != collection);
+
+  rc = collection->read_lob(elem.__oid(), &m_lob_root, data, size);
+  if (rc != 0) {
+    goto error;
+  }
+
+  if (blob->binary() ||
+      sdb_is_same_in_charset(data, size, &SDB_CHARSET, blob->charset())) {
+    blob->set_ptr((uint32)size, (uchar *)data);
+  } else {
+    blob->store(data, size, &SDB_CHARSET);
+    rc = keep_blob_value(field, &m_lob_root);
+    if (rc != 0) {
+      goto error;
+    }
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+/*
+  Remove the LOBs referred by the current row, which is deleted, or only
+  those of the fields overwritten by the update rule.
+*/
+void ha_sdb::remove_row_lobs(const bson::BSONObj &rule) {
+  Sdb_conn *conn = check_sdb_in_thd(ha_thd(), true);
+  bson::BSONObj set_obj = rule.getObjectField("$set");
+  bson::BSONObj unset_obj = rule.getObjectField("$unset");
+
+  if (NULL == conn) {
+    return;
+  }
+
+  for (Field **fields = table->field; *fields; fields++) {
+    Field *field = *fields;
+    if (!is_lob_field(field)) {
+      continue;
+    }
+
+    bson::BSONElement elem = cur_rec.getField(field->field_name);
+    if (bson::jstOID != elem.type()) {
+      continue;
+    }
+    if (!rule.isEmpty() && !set_obj.hasField(field->field_name) &&
+        !unset_obj.hasField(field->field_name)) {
+      continue;
+    }
+    conn->remove_lob(db_name, table_name, elem.__oid());
+  }
+}
+
+// The rows failed to be written, so the LOBs created for them are useless.
+void ha_sdb::remove_created_lobs(std::vector<bson::OID> &lobs) {
+  Sdb_conn *conn = NULL;
+
+  if (lobs.empty()) {
+    return;
+  }
+
+  conn = check_sdb_in_thd(ha_thd(), true);
+  if (NULL != conn) {
+    for (std::vector<bson::OID>::iterator it = lobs.begin(); it != lobs.end();
+         ++it) {
+      conn->remove_lob(db_name, table_name, *it);
+    }
+  }
+  lobs.clear();
+}
+
 /*
   If table has unique keys, we can match a specific record by the value of
   unique key instead of the whole record.
@@ -576,6 +940,76 @@ done:
   return rc;
 }
 
+/*
+  The condition of the row to be updated or deleted, which matches it by a
+  unique key, or by _id. The sharding key fields of the row are always
+  included, so that the request is sent to the group of the row only
+  instead of all groups.
+*/
+void ha_sdb::get_write_cond(const uchar *rec_row, bson::BSONObj &cond) {
+  bson::BSONElement be_oid;
+  bool by_oid = false;
+  bool complete = true;
+
+  if (get_unique_key_cond(rec_row, cond)) {
+    if (!cur_rec.getObjectID(be_oid) || bson::jstOID != be_oid.type()) {
+      cond = cur_rec;
+      return;
+    }
+    by_oid = true;
+  }
+
+  // The unique keys include the sharding key if created by this engine.
+  bson::BSONObjIterator check_it(m_sharding_key);
+  while (complete && check_it.more()) {
+    complete = cond.hasField(check_it.next().fieldName());
+  }
+  if (!by_oid && complete) {
+    return;
+  }
+
+  bson::BSONObjBuilder builder;
+  if (by_oid) {
+    builder.append(be_oid);
+  } else {
+    builder.appendElements(cond);
+  }
+  bson::BSONObjIterator it(m_sharding_key);
+  while (it.more()) {
+    const char *field_name = it.next().fieldName();
+    bson::BSONElement elem = cur_rec.getField(field_name);
+    if ((by_oid || !cond.hasField(field_name)) && bson::EOO != elem.type()) {
+      builder.append(elem);
+    }
+  }
+  cond = builder.obj();
+}
+
+/*
+  The ShardingKey of the collection is loaded once per share. It's only used
+  to route the writes, so the table is still usable if it fails.
+*/
+void ha_sdb::load_sharding_key(Sdb_conn *conn) {
+  bson::BSONObj sharding_key;
+  Sdb_mutex_guard guard(share->mutex);
+
+  if (NULL == share->sharding_key) {
+    if (0 != conn->get_cl_sharding_key(db_name, table_name, sharding_key)) {
+      SDB_LOG_WARNING("Failed to get ShardingKey of %s.%s", db_name,
+                      table_name);
+      m_sharding_key = SDB_EMPTY_BSON;
+      return;
+    }
+    share->sharding_key = new (std::nothrow) bson::BSONObj(sharding_key);
+    if (NULL == share->sharding_key) {
+      m_sharding_key = sharding_key;
+      return;
+    }
+  }
+  // Copied, so that the buffer isn't shared by threads.
+  m_sharding_key = share->sharding_key->copy();
+}
+
 /*
   @return false if success
 */
@@ -615,6 +1049,32 @@ error:
   goto done;
 }
 
+/*
+  During read removal only the fields of the active unique key are valid in
+  the row, so the condition must be built from that key alone.
+
+  @return false if success
+*/
+my_bool ha_sdb::get_read_removal_cond(const uchar *rec_row,
+                                      bson::BSONObj &cond) {
+  my_bool rc = true;
+  uchar *row = const_cast<uchar *>(rec_row);
+  DBUG_ASSERT(active_index < MAX_KEY);
+
+  my_bitmap_map *org_bitmap = dbug_tmp_use_all_columns(table, table->read_set);
+  if (row != table->record[0]) {
+    repoint_field_to_record(table, table->record[0], row);
+  }
+
+  rc = get_cond_from_key(table->key_info + active_index, cond);
+
+  if (row != table->record[0]) {
+    repoint_field_to_record(table, row, table->record[0]);
+  }
+  dbug_tmp_restore_column_map(table->read_set, org_bitmap);
+  return rc;
+}
+
 int ha_sdb::get_update_obj(const uchar *old_data, uchar *new_data,
                            bson::BSONObj &obj, bson::BSONObj &null_obj) {
   int rc = 0;
@@ -630,6 +1090,23 @@ int ha_sdb::get_update_obj(const uchar *old_data, uchar *new_data,
   for (Field **fields = table->field; *fields; fields++) {
     Field *field = *fields;
     bool is_null = field->is_null();
+    if (m_read_removal_row) {
+      // The old row was never fetched, so it can't be compared with the new
+      // one. Write all the assigned fields.
+      if (!bitmap_is_set(table->write_set, field->field_index)) {
+        continue;
+      }
+      if (is_null) {
+        null_obj_builder.append(field->field_name, "");
+      } else {
+        rc = field_to_obj(field, obj_builder);
+        if (0 != rc) {
+          goto error;
+        }
+      }
+      continue;
+    }
+
     if (is_null != field->is_null_in_record(old_data)) {
       if (is_null) {
         null_obj_builder.append(field->field_name, "");
@@ -662,12 +1139,21 @@ error:
 }
 
 void ha_sdb::start_bulk_insert(ha_rows rows) {
-  if (!sdb_use_bulk_insert) {
+  THD *thd = ha_thd();
+
+  // The rows skipped as duplicate by the server are unknown, and so are the
+  // LOBs created for them.
+  if (!sdb_use_bulk_insert ||
+      (m_use_lob && thd->lex && thd->lex->is_ignore())) {
     m_use_bulk_insert = false;
     return;
   }
 
   m_bulk_insert_rows.clear();
+  m_bulk_insert_lobs[0].clear();
+  m_bulk_insert_lobs[1].clear();
+  m_bulk_insert_bytes = 0;
+  m_async_insert_bytes = 0;
 
   /**
     We don't bother with bulk-insert semantics when the estimated rows == 1
@@ -680,36 +1166,465 @@ void ha_sdb::start_bulk_insert(ha_rows rows) {
   }
 
   m_use_bulk_insert = true;
+  m_use_async_bulk_insert = sdb_use_async_bulk_insert;
+
+  Thd_sdb *thd_sdb = thd_get_thd_sdb(thd);
+  m_bulk_insert_ctrl = thd_sdb ? &thd_sdb->bulk_insert_ctrl : NULL;
 }
 
-int ha_sdb::flush_bulk_insert(bool ignore_dup_key) {
-  DBUG_ASSERT(m_bulk_insert_rows.size() > 0);
-  DBUG_ASSERT(NULL != collection);
-  DBUG_ASSERT(collection->thread_id() == ha_thd()->thread_id());
+/*
+  One more batch is buffered while the other is in flight in async mode, so
+  each of them may take only half of the memory. The bytes buffered by all
+  handlers of the session are capped as a whole in write_row().
+*/
+ulonglong ha_sdb::bulk_insert_max_bytes() {
+  ulonglong max_bytes = sdb_bulk_insert_max_bytes;
+  return m_use_async_bulk_insert ? max_bytes / 2 : max_bytes;
+}
 
-  int flag = ignore_dup_key ? FLG_INSERT_CONTONDUP : 0;
+ulonglong ha_sdb::bulk_insert_target_bytes() {
+  ulonglong max_bytes = bulk_insert_max_bytes();
+  return m_bulk_insert_ctrl ? m_bulk_insert_ctrl->target_bytes(max_bytes)
+                            : max_bytes;
+}
 
-  int rc = collection->bulk_insert(flag, m_bulk_insert_rows);
+// The batch in flight is done, its LOBs are useless if it failed.
+void ha_sdb::finish_async_insert_lobs(int rc) {
+  std::vector<bson::OID> &lobs = m_bulk_insert_lobs[1 - m_insert_arena_idx];
   if (rc != 0) {
-    if (SDB_IXM_DUP_KEY == get_sdb_code(rc)) {
-      // convert to MySQL errcode
-      rc = HA_ERR_FOUND_DUPP_KEY;
-    }
+    remove_created_lobs(lobs);
+  } else {
+    lobs.clear();
   }
-  stats.records += m_bulk_insert_rows.size();
-  m_bulk_insert_rows.clear();
-  return rc;
 }
 
-int ha_sdb::end_bulk_insert() {
+int ha_sdb::flush_bulk_insert(bool ignore_dup_key) {
   int rc = 0;
+  int flag = ignore_dup_key ? FLG_INSERT_CONTONDUP : 0;
+  ulonglong bytes = m_bulk_insert_bytes;
+  ulonglong max_bytes = bulk_insert_max_bytes();
+  bool in_flight = false;
 
-  if (m_use_bulk_insert) {
+  DBUG_ASSERT(m_bulk_insert_rows.size() > 0);
+  DBUG_ASSERT(NULL != collection);
+  DBUG_ASSERT(collection->thread_id() == ha_thd()->thread_id());
+
+  if (m_bulk_replace_conds.size() > 0) {
+    rc = remove_replaced_rows();
+    if (rc != 0) {
+      goto error;
+    }
+  }
+
+  stats.records += m_bulk_insert_rows.size();
+  if (m_use_async_bulk_insert) {
+    // The batch is sent in background, the error of previous batch if any is
+    // returned here.
+    rc = collection->wait_async();
+    if (m_async_insert_bytes > 0 && m_bulk_insert_ctrl) {
+      m_bulk_insert_ctrl->feedback(m_async_insert_bytes,
+                                   collection->async_usecs(), rc, max_bytes);
+      m_bulk_insert_ctrl->release(m_async_insert_bytes);
+    }
+    m_async_insert_bytes = 0;
+    finish_async_insert_lobs(rc);
+    if (0 == rc) {
+      rc = collection->bulk_insert_async(flag, m_bulk_insert_rows);
+      if (0 == rc) {
+        // The rows in flight live in current arena, fill the other one.
+        m_async_insert_bytes = bytes;
+        m_insert_arena_idx = 1 - m_insert_arena_idx;
+        in_flight = true;
+      }
+    }
+  } else {
+    ulonglong begin = my_micro_time();
+    rc = collection->bulk_insert(flag, m_bulk_insert_rows);
+    if (m_bulk_insert_ctrl) {
+      m_bulk_insert_ctrl->feedback(bytes, my_micro_time() - begin, rc,
+                                   max_bytes);
+    }
+  }
+  if (rc != 0) {
+    if (SDB_IXM_DUP_KEY == get_sdb_code(rc)) {
+      // convert to MySQL errcode
+      rc = HA_ERR_FOUND_DUPP_KEY;
+    }
+  }
+
+done:
+  // The rows in flight are still buffered until their result is known.
+  if (!in_flight && m_bulk_insert_ctrl) {
+    m_bulk_insert_ctrl->release(bytes);
+  }
+  // The LOBs of the rows in flight are kept until their result is known.
+  if (rc != 0) {
+    remove_created_lobs(m_bulk_insert_lobs[m_insert_arena_idx]);
+  } else {
+    m_bulk_insert_lobs[m_insert_arena_idx].clear();
+  }
+  m_bulk_insert_rows.clear();
+  m_bulk_replace_conds.clear();
+  m_bulk_replace_keys.clear();
+  m_bulk_insert_bytes = 0;
+  m_insert_arena[m_insert_arena_idx].reset();
+  return rc;
+error:
+  goto done;
+}
+
+/*
+  Bulk REPLACE removes all the rows conflicting with the batch in one request
+  before the batch is inserted.
+*/
+int ha_sdb::remove_replaced_rows() {
+  int rc = 0;
+  const KEY *key_info = table->key_info + m_upsert_key;
+  bson::BSONObjBuilder cond_builder;
+  bson::BSONObj cond;
+  Sdb_conn *undo = undo_log();
+
+  DBUG_ASSERT(m_upsert_key < MAX_KEY);
+
+  // The removed rows are unknown.
+  if (undo) {
+    undo->lose_undo();
+  }
+
+  if (1 == key_info->user_defined_key_parts) {
+    const char *field_name =
+        m_bulk_replace_conds[0].firstElement().fieldName();
+    bson::BSONObjBuilder sub_builder(cond_builder.subobjStart(field_name));
+    bson::BSONArrayBuilder arr_builder(sub_builder.subarrayStart("$in"));
+    for (std::vector<bson::BSONObj>::iterator it =
+             m_bulk_replace_conds.begin();
+         it != m_bulk_replace_conds.end(); ++it) {
+      arr_builder.append(it->firstElement());
+    }
+    arr_builder.doneFast();
+    sub_builder.doneFast();
+  } else {
+    bson::BSONArrayBuilder arr_builder(cond_builder.subarrayStart("$or"));
+    for (std::vector<bson::BSONObj>::iterator it =
+             m_bulk_replace_conds.begin();
+         it != m_bulk_replace_conds.end(); ++it) {
+      arr_builder.append(*it);
+    }
+    arr_builder.doneFast();
+  }
+  cond = cond_builder.obj();
+
+  rc = collection->del(cond, BSON("" << key_info->name));
+  return rc;
+}
+
+/*
+  A batch can't hold two rows with the same key, or the later one would fail
+  to be inserted instead of replacing the former. The keys are looked up by
+  the bytes of their conditions, which are built alike for the same value.
+*/
+bool ha_sdb::is_pending_replace(const bson::BSONObj &key_cond) {
+  std::string key(key_cond.objdata(), key_cond.objsize());
+  return m_bulk_replace_keys.find(key) != m_bulk_replace_keys.end();
+}
+
+/*
+  Insert the row, or update the row conflicting with it on the only unique
+  key. REPLACE overwrites all the fields, while ON DUPLICATE KEY UPDATE only
+  overwrites the fields in its update list.
+*/
+int ha_sdb::upsert_row(uchar *buf, const bson::BSONObj &key_cond) {
+  int rc = 0;
+  bson::BSONObjBuilder set_builder;
+  bson::BSONObjBuilder unset_builder;
+  bson::BSONObjBuilder insert_builder;
+  bson::BSONObj set_obj;
+  bson::BSONObj unset_obj;
+  bson::BSONObj rule_obj;
+
+  DBUG_ASSERT(m_upsert_key < MAX_KEY);
+
+  my_bitmap_map *org_bitmap = dbug_tmp_use_all_columns(table, table->read_set);
+  if (buf != table->record[0]) {
+    repoint_field_to_record(table, table->record[0], buf);
+  }
+
+  for (Field **fields = table->field; *fields; fields++) {
+    Field *field = *fields;
+    bool is_update =
+        !m_insert_with_update || m_upsert_fields.is_set(field->field_index);
+    if (field->is_null()) {
+      if (is_update) {
+        unset_builder.append(field->field_name, "");
+      }
+    } else {
+      rc = field_to_obj(field, is_update ? set_builder : insert_builder);
+      if (0 != rc) {
+        goto error;
+      }
+    }
+  }
+
+  set_obj = set_builder.obj();
+  unset_obj = unset_builder.obj();
+  if (unset_obj.isEmpty()) {
+    rule_obj = BSON("$set" << set_obj);
+  } else {
+    rule_obj = BSON("$set" << set_obj << "$unset" << unset_obj);
+  }
+
+  rc = collection->upsert(rule_obj, key_cond,
+                          BSON("" << table->key_info[m_upsert_key].name),
+                          insert_builder.obj(), UPDATE_KEEP_SHARDINGKEY);
+  if (rc != 0) {
+    if (SDB_IXM_DUP_KEY == get_sdb_code(rc)) {
+      // convert to MySQL errcode
+      rc = HA_ERR_FOUND_DUPP_KEY;
+    }
+    goto error;
+  }
+
+done:
+  if (buf != table->record[0]) {
+    repoint_field_to_record(table, buf, table->record[0]);
+  }
+  dbug_tmp_restore_column_map(table->read_set, org_bitmap);
+  return rc;
+error:
+  goto done;
+}
+
+/*
+  Conflicts can be resolved by the remote server only when the conflicting
+  row is unambiguous, that is, the table has exactly one unique key. And the
+  resolved rows are invisible to the row-based binlog.
+*/
+bool ha_sdb::init_upsert_key() {
+  uint key_count = 0;
+
+  m_upsert_key = MAX_KEY;
+  // The LOBs of the rows overwritten by the remote server would be leaked.
+  if (sdb_is_row_binlogged(ha_thd()) || m_use_lob) {
+    return false;
+  }
+
+  for (uint i = 0; i < table->s->keys; ++i) {
+    if (table->key_info[i].flags & HA_NOSAME) {
+      m_upsert_key = i;
+      key_count++;
+    }
+  }
+
+  if (key_count != 1) {
+    m_upsert_key = MAX_KEY;
+    return false;
+  }
+  return true;
+}
+
+/*
+  Only the simple form of ON DUPLICATE KEY UPDATE is supported, in which
+  every field is assigned by VALUES() of itself, like
+  `ON DUPLICATE KEY UPDATE a = VALUES(a), b = VALUES(b)`.
+*/
+bool ha_sdb::init_upsert_fields() {
+  THD *thd = ha_thd();
+  LEX *lex = thd->lex;
+  Sql_cmd_insert_base *sql_cmd = NULL;
+  Item *field_item = NULL;
+  Item *value_item = NULL;
+
+  m_upsert_fields.clear_all();
+
+  if ((SQLCOM_INSERT != lex->sql_command &&
+       SQLCOM_INSERT_SELECT != lex->sql_command) ||
+      NULL == lex->m_sql_cmd) {
+    return false;
+  }
+
+  if (table->triggers && table->triggers->has_update_triggers()) {
+    return false;
+  }
+
+  sql_cmd = static_cast<Sql_cmd_insert_base *>(lex->m_sql_cmd);
+  List_iterator_fast<Item> field_it(sql_cmd->insert_update_list);
+  List_iterator_fast<Item> value_it(sql_cmd->insert_value_list);
+  while ((field_item = field_it++)) {
+    value_item = value_it++;
+    if (NULL == value_item || Item::FIELD_ITEM != field_item->type() ||
+        Item::INSERT_VALUE_ITEM != value_item->type()) {
+      return false;
+    }
+
+    Field *field = ((Item_field *)field_item)->field;
+    Item *arg = ((Item_insert_value *)value_item)->arg;
+    if (NULL == field || field->table != table || NULL == arg ||
+        Item::FIELD_ITEM != arg->type() ||
+        NULL == ((Item_field *)arg)->field ||
+        ((Item_field *)arg)->field->field_index != field->field_index) {
+      return false;
+    }
+    m_upsert_fields.set_bit(field->field_index);
+  }
+
+  return true;
+}
+
+/*
+  An autocommit INSERT of one row, without triggers or conflict resolution,
+  is sent in one request, which is atomic by itself. So it needn't begin
+  and commit a transaction, and takes one round trip instead of three.
+*/
+bool ha_sdb::is_single_row_insert() {
+  LEX *lex = ha_thd()->lex;
+
+  if (SQLCOM_INSERT != lex->sql_command || NULL == lex->m_sql_cmd ||
+      DUP_ERROR != lex->duplicates || m_use_bulk_insert || m_use_lob ||
+      NULL != table->triggers) {
+    return false;
+  }
+
+  Sql_cmd_insert_base *sql_cmd =
+      static_cast<Sql_cmd_insert_base *>(lex->m_sql_cmd);
+  return 1 == sql_cmd->insert_many_values.elements;
+}
+
+// Mark the parts of key which item is the field of.
+static void sdb_mark_key_part(Item *item, TABLE *table, const KEY *key,
+                              key_part_map &parts) {
+  Field *field = NULL;
+
+  item = item->real_item();
+  if (Item::FIELD_ITEM != item->type()) {
+    return;
+  }
+  field = ((Item_field *)item)->field;
+  if (field->table != table) {
+    return;
+  }
+  for (uint i = 0; i < key->user_defined_key_parts; i++) {
+    if (key->key_part[i].fieldnr - 1 == field->field_index) {
+      parts |= ((key_part_map)1 << i);
+    }
+  }
+}
+
+// Mark the parts of key which are equal to a constant by item.
+static void sdb_mark_const_key_parts(Item *item, TABLE *table,
+                                     const KEY *key, key_part_map &parts) {
+  if (Item::FUNC_ITEM != item->type()) {
+    return;
+  }
+
+  Item_func *func = (Item_func *)item;
+  if (Item_func::EQ_FUNC == func->functype()) {
+    Item **args = func->arguments();
+    if (args[1]->const_item()) {
+      sdb_mark_key_part(args[0], table, key, parts);
+    }
+    if (args[0]->const_item()) {
+      sdb_mark_key_part(args[1], table, key, parts);
+    }
+  } else if (Item_func::MULT_EQUAL_FUNC == func->functype()) {
+    Item_equal *item_equal = (Item_equal *)func;
+    if (NULL != item_equal->get_const()) {
+      Item_equal_iterator it(*item_equal);
+      Item_field *item_field = NULL;
+      while ((item_field = it++)) {
+        sdb_mark_key_part(item_field, table, key, parts);
+      }
+    }
+  }
+}
+
+/*
+  UPDATE or DELETE with read removal may match several rows by the active
+  unique key, like 'WHERE pk IN (1, 2, 3)'. Only if the condition sets all
+  parts of the key equal to constants, at most one row is written.
+*/
+bool ha_sdb::is_single_row_removal() {
+  Item *cond = ha_thd()->lex->select_lex->where_cond();
+  const KEY *key = NULL;
+  key_part_map parts = 0;
+
+  if (NULL == cond || active_index >= MAX_KEY) {
+    return false;
+  }
+  key = table->key_info + active_index;
+  if (!(key->flags & HA_NOSAME)) {
+    return false;
+  }
+
+  if (Item::COND_ITEM == cond->type() &&
+      Item_func::COND_AND_FUNC == ((Item_cond *)cond)->functype()) {
+    List_iterator_fast<Item> it(*((Item_cond *)cond)->argument_list());
+    Item *item = NULL;
+    while ((item = it++)) {
+      sdb_mark_const_key_parts(item, table, key, parts);
+    }
+  } else {
+    sdb_mark_const_key_parts(cond, table, key, parts);
+  }
+  return make_prev_keypart_map(key->user_defined_key_parts) == parts;
+}
+
+/*
+  @return false if success
+*/
+my_bool ha_sdb::get_upsert_cond(uchar *buf, bson::BSONObj &cond) {
+  my_bool rc = true;
+  const KEY *key_info = table->key_info + m_upsert_key;
+  const KEY_PART_INFO *key_part = key_info->key_part;
+  const KEY_PART_INFO *key_end = key_part + key_info->user_defined_key_parts;
+
+  DBUG_ASSERT(m_upsert_key < MAX_KEY);
+
+  my_bitmap_map *org_bitmap = dbug_tmp_use_all_columns(table, table->read_set);
+  if (buf != table->record[0]) {
+    repoint_field_to_record(table, table->record[0], buf);
+  }
+
+  // NULL never conflicts with others.
+  for (; key_part != key_end; ++key_part) {
+    if (table->field[key_part->fieldnr - 1]->is_null()) {
+      goto done;
+    }
+  }
+  rc = get_cond_from_key(key_info, cond);
+
+done:
+  if (buf != table->record[0]) {
+    repoint_field_to_record(table, buf, table->record[0]);
+  }
+  dbug_tmp_restore_column_map(table->read_set, org_bitmap);
+  return rc;
+}
+
+int ha_sdb::end_bulk_insert() {
+  int rc = 0;
+
+  if (m_use_bulk_insert) {
     m_use_bulk_insert = false;
     if (m_bulk_insert_rows.size() > 0) {
       bool ignore_dup_key = ha_thd()->lex && ha_thd()->lex->is_ignore();
       rc = flush_bulk_insert(ignore_dup_key);
     }
+    if (m_use_async_bulk_insert) {
+      int wait_rc = collection->wait_async();
+      if (m_async_insert_bytes > 0 && m_bulk_insert_ctrl) {
+        m_bulk_insert_ctrl->feedback(m_async_insert_bytes,
+                                     collection->async_usecs(), wait_rc,
+                                     bulk_insert_max_bytes());
+        m_bulk_insert_ctrl->release(m_async_insert_bytes);
+      }
+      m_async_insert_bytes = 0;
+      m_use_async_bulk_insert = false;
+      finish_async_insert_lobs(wait_rc);
+      if (0 == rc && wait_rc != 0) {
+        rc = (SDB_IXM_DUP_KEY == get_sdb_code(wait_rc)) ? HA_ERR_FOUND_DUPP_KEY
+                                                        : wait_rc;
+      }
+    }
   }
 
   return rc;
@@ -718,22 +1633,94 @@ int ha_sdb::end_bulk_insert() {
 int ha_sdb::write_row(uchar *buf) {
   int rc = 0;
   bson::BSONObj obj;
-  bson::BSONObj tmp_obj;
+  bson::BSONObj key_cond;
   bool ignore_dup_key = ha_thd()->lex && ha_thd()->lex->is_ignore();
+  bool is_replace = false;
+  Sdb_conn *undo = NULL;
 
   ha_statistic_increment(&SSV::ha_write_count);
 
   DBUG_ASSERT(NULL != collection);
   DBUG_ASSERT(collection->thread_id() == ha_thd()->thread_id());
 
-  rc = row_to_obj(buf, obj, TRUE, FALSE, tmp_obj);
+  m_created_lobs.clear();
+  if (!is_single_row_insert()) {
+    rc = ensure_transaction();
+    if (rc != 0) {
+      goto error;
+    }
+  }
+
+  if (table->next_number_field && buf == table->record[0]) {
+    rc = update_auto_increment();
+    if (rc != 0) {
+      goto error;
+    }
+    // The value is set explicitly instead of generated.
+    if (0 == insert_id_for_cur_row) {
+      rc = raise_auto_inc_by_row(buf);
+      if (rc != 0) {
+        goto error;
+      }
+    }
+  }
+
+  if ((m_write_can_replace || m_insert_with_update) &&
+      !get_upsert_cond(buf, key_cond)) {
+    if (m_insert_with_update || !m_use_bulk_insert) {
+      // The overwritten row is unknown.
+      undo = undo_log();
+      if (undo) {
+        undo->lose_undo();
+      }
+      rc = upsert_row(buf, key_cond);
+      if (rc != 0) {
+        goto error;
+      }
+      goto done;
+    }
+    is_replace = true;
+    // Flushed before the row is encoded, because the flush resets or switches
+    // the arena that the row would be built in.
+    if (is_pending_replace(key_cond)) {
+      rc = flush_bulk_insert(ignore_dup_key);
+      if (rc != 0) {
+        goto error;
+      }
+    }
+  }
+
+  rc = encode_row(buf, m_insert_arena[m_insert_arena_idx], obj);
   if (rc != 0) {
     goto error;
   }
 
+  // _id is the first element generated by encode_row().
+  undo = undo_log();
+  if (undo) {
+    undo->log_insert(db_name, table_name, obj.firstElement().__oid());
+  }
+
   if (m_use_bulk_insert) {
+    if (is_replace) {
+      m_bulk_replace_conds.push_back(key_cond);
+      m_bulk_replace_keys.insert(
+          std::string(key_cond.objdata(), key_cond.objsize()));
+    }
     m_bulk_insert_rows.push_back(obj);
-    if ((int)m_bulk_insert_rows.size() >= sdb_bulk_insert_size) {
+    m_bulk_insert_bytes += obj.objsize();
+    if (m_bulk_insert_ctrl) {
+      m_bulk_insert_ctrl->buffer(obj.objsize());
+    }
+    // The LOBs are removed with the batch if it fails.
+    m_bulk_insert_lobs[m_insert_arena_idx].insert(
+        m_bulk_insert_lobs[m_insert_arena_idx].end(), m_created_lobs.begin(),
+        m_created_lobs.end());
+    m_created_lobs.clear();
+    if ((int)m_bulk_insert_rows.size() >= sdb_bulk_insert_size ||
+        m_bulk_insert_bytes >= bulk_insert_target_bytes() ||
+        (m_bulk_insert_ctrl && m_bulk_insert_ctrl->buffered_bytes() >=
+                                   sdb_bulk_insert_max_bytes)) {
       rc = flush_bulk_insert(ignore_dup_key);
       if (rc != 0) {
         goto error;
@@ -748,6 +1735,7 @@ int ha_sdb::write_row(uchar *buf) {
     std::vector<bson::BSONObj> row(1, obj);
     int flag = ignore_dup_key ? FLG_INSERT_CONTONDUP : 0;
     rc = collection->bulk_insert(flag, row);
+    m_insert_arena[m_insert_arena_idx].reset();
     if (rc != 0) {
       if (SDB_IXM_DUP_KEY == get_sdb_code(rc)) {
         // convert to MySQL errcode
@@ -762,72 +1750,427 @@ int ha_sdb::write_row(uchar *buf) {
 done:
   return rc;
 error:
+  remove_created_lobs(m_created_lobs);
   goto done;
 }
 
-int ha_sdb::update_row(const uchar *old_data, uchar *new_data) {
+int ha_sdb::get_update_rule(const uchar *old_data, uchar *new_data,
+                            bson::BSONObj &rule) {
   int rc = 0;
-  bson::BSONObj cond;
   bson::BSONObj new_obj;
   bson::BSONObj null_obj;
+
+  rc = get_update_obj(old_data, new_data, new_obj, null_obj);
+  if (rc != 0) {
+    if (HA_ERR_UNKNOWN_CHARSET == rc && ha_thd()->lex->is_ignore()) {
+      rc = 0;
+    } else {
+      goto error;
+    }
+  }
+
+  if (null_obj.isEmpty()) {
+    rule = BSON("$set" << new_obj);
+  } else {
+    rule = BSON("$set" << new_obj << "$unset" << null_obj);
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+bool ha_sdb::start_bulk_update() {
+  THD *thd = ha_thd();
+
+  /*
+    Batched rows are not written to the row-based binlog by the SQL layer,
+    and UPDATE IGNORE needs to know which row hits a duplicate key.
+    Triggers may read the rows which have not been updated yet.
+  */
+  if (sdb_is_row_binlogged(thd) || (thd->lex && thd->lex->is_ignore()) ||
+      (table->triggers && table->triggers->has_update_triggers())) {
+    return true;
+  }
+
+  // The overwritten LOBs of each row are removed after it's updated.
+  if (m_use_lob) {
+    return true;
+  }
+
+  m_bulk_update_oids.clear();
+  m_bulk_update_rule = SDB_EMPTY_BSON;
+  m_dup_key_nr = (uint)-1;
+  m_use_bulk_update = true;
+  return false;
+}
+
+/*
+  Rows updated by the same rule, which is common when the new values are
+  constants, are sent in one request matched by their _id.
+*/
+int ha_sdb::bulk_update_row(const uchar *old_data, uchar *new_data,
+                            uint *dup_key_found) {
+  int rc = 0;
   bson::BSONObj rule_obj;
+  bson::BSONElement be_oid;
+  Sdb_conn *undo = NULL;
+
+  DBUG_ASSERT(NULL != collection);
+  DBUG_ASSERT(collection->thread_id() == ha_thd()->thread_id());
+
+  *dup_key_found = 0;
+
+  if (!m_use_bulk_update || m_read_removal_row ||
+      !cur_rec.getObjectID(be_oid) || bson::jstOID != be_oid.type()) {
+    rc = update_row(old_data, new_data);
+    goto done;
+  }
+
+  ha_statistic_increment(&SSV::ha_update_count);
+
+  rc = ensure_transaction();
+  if (rc != 0) {
+    goto error;
+  }
+
+  rc = raise_auto_inc_by_row(new_data);
+  if (rc != 0) {
+    goto error;
+  }
+
+  rc = get_update_rule(old_data, new_data, rule_obj);
+  if (rc != 0) {
+    goto error;
+  }
+
+  if (m_bulk_update_oids.size() > 0 &&
+      0 != rule_obj.woCompare(m_bulk_update_rule)) {
+    rc = flush_bulk_update();
+    if (rc != 0) {
+      goto error;
+    }
+  }
+
+  if (m_bulk_update_oids.empty()) {
+    m_bulk_update_rule = rule_obj;
+  }
+  undo = undo_log();
+  if (undo) {
+    undo->log_update(db_name, table_name, cur_rec);
+  }
+  m_bulk_update_oids.push_back(be_oid.__oid());
+  if ((int)m_bulk_update_oids.size() >= sdb_bulk_update_size) {
+    rc = flush_bulk_update();
+    if (rc != 0) {
+      goto error;
+    }
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+int ha_sdb::flush_bulk_update() {
+  int rc = 0;
+  bson::BSONObj cond;
+
+  DBUG_ASSERT(m_bulk_update_oids.size() > 0);
+  DBUG_ASSERT(NULL != collection);
+  DBUG_ASSERT(collection->thread_id() == ha_thd()->thread_id());
+
+  sdb_build_oid_in_cond(m_bulk_update_oids, cond);
+  rc = collection->update(m_bulk_update_rule, cond, BSON("" << SDB_OID_INDEX),
+                          UPDATE_KEEP_SHARDINGKEY);
+  if (rc != 0) {
+    if (SDB_IXM_DUP_KEY == get_sdb_code(rc)) {
+      // convert to MySQL errcode
+      rc = HA_ERR_FOUND_DUPP_KEY;
+      locate_bulk_update_dup(m_bulk_update_rule, cond);
+    }
+  }
+  m_bulk_update_oids.clear();
+  m_bulk_update_rule = SDB_EMPTY_BSON;
+  return rc;
+}
+
+/*
+  Put the new image of the row whose update hits a duplicate key into
+  record[0], and find the unique key it duplicates by looking for another
+  row of the same key value. If the request updates several rows, the
+  first row found duplicated is taken. It's best-effort, the error is
+  reported without the key if nothing is found.
+*/
+void ha_sdb::locate_bulk_update_dup(const bson::BSONObj &rule,
+                                    const bson::BSONObj &cond) {
+  bson::BSONObj set_obj = rule.getObjectField("$set");
+  bson::BSONObj unset_obj = rule.getObjectField("$unset");
+  bson::BSONObjIterator oid_it(
+      cond.getObjectField(SDB_OID_FIELD).getObjectField("$in"));
+
+  while (oid_it.more()) {
+    bson::BSONElement be_oid = oid_it.next();
+    bson::BSONObj old_obj;
+    if (0 != collection->query_one(old_obj, BSON(SDB_OID_FIELD << be_oid.OID()),
+                                   SDB_EMPTY_BSON, SDB_EMPTY_BSON,
+                                   BSON("" << SDB_OID_INDEX))) {
+      continue;
+    }
+
+    bson::BSONObjBuilder builder;
+    bson::BSONObjIterator old_it(old_obj);
+    while (old_it.more()) {
+      bson::BSONElement elem = old_it.next();
+      if (!set_obj.hasField(elem.fieldName()) &&
+          !unset_obj.hasField(elem.fieldName())) {
+        builder.append(elem);
+      }
+    }
+    builder.appendElements(set_obj);
+    bson::BSONObj new_obj = builder.obj();
+    if (0 != obj_to_row(new_obj, table->record[0])) {
+      continue;
+    }
+
+    for (uint i = 0; i < table->s->keys; ++i) {
+      const KEY *key_info = table->key_info + i;
+      bson::BSONObj key_cond;
+      bson::BSONObj dup_obj;
+      if (!(key_info->flags & HA_NOSAME) ||
+          get_cond_from_key(key_info, key_cond)) {
+        continue;
+      }
+      bson::BSONObjBuilder dup_builder;
+      dup_builder.appendElements(key_cond);
+      dup_builder.append(SDB_OID_FIELD, BSON("$ne" << be_oid.OID()));
+      if (0 == collection->query_one(dup_obj, dup_builder.obj())) {
+        m_dup_key_nr = i;
+        return;
+      }
+    }
+  }
+}
+
+/*
+  UPDATE IGNORE isn't batched, so no duplicate key is ignored here. A
+  duplicate key fails the statement, with the row located in record[0].
+*/
+int ha_sdb::exec_bulk_update(uint *dup_key_found) {
+  int rc = 0;
+
+  *dup_key_found = 0;
+  if (m_bulk_update_oids.size() > 0) {
+    rc = flush_bulk_update();
+  }
+  return rc;
+}
+
+void ha_sdb::end_bulk_update() {
+  DBUG_ASSERT(m_bulk_update_oids.empty());
+  m_use_bulk_update = false;
+  m_bulk_update_oids.clear();
+  m_bulk_update_rule = SDB_EMPTY_BSON;
+}
+
+int ha_sdb::update_row(const uchar *old_data, uchar *new_data) {
+  int rc = 0;
+  bson::BSONObj cond;
+  bson::BSONObj rule_obj;
+  bson::BSONObj old_obj;
+  Sdb_conn *undo = NULL;
+
+  DBUG_ASSERT(NULL != collection);
+  DBUG_ASSERT(collection->thread_id() == ha_thd()->thread_id());
+
+  ha_statistic_increment(&SSV::ha_update_count);
+
+  m_created_lobs.clear();
+  // The row of read removal is updated by one atomic request, which needs
+  // no transaction if it's the only row of the statement.
+  if (!m_read_removal_row || !is_single_row_removal()) {
+    rc = ensure_transaction();
+    if (rc != 0) {
+      goto error;
+    }
+  }
+
+  rc = raise_auto_inc_by_row(new_data);
+  if (rc != 0) {
+    goto error;
+  }
+
+  rc = get_update_rule(old_data, new_data, rule_obj);
+  if (rc != 0) {
+    goto error;
+  }
+
+  undo = undo_log();
+  if (m_read_removal_row) {
+    if (get_read_removal_cond(old_data, cond)) {
+      rc = HA_ERR_INTERNAL_ERROR;
+      goto error;
+    }
+    rc = collection->query_and_update_one(
+        rule_obj, cond, BSON("" << table->key_info[active_index].name),
+        QUERY_WITH_RETURNDATA | QUERY_KEEP_SHARDINGKEY_IN_UPDATE,
+        undo ? &old_obj : NULL);
+    if (HA_ERR_END_OF_FILE == rc) {
+      // the row doesn't exist, nothing is updated
+      rc = 0;
+      goto done;
+    }
+    // The row is updated by one request, which changes nothing if failed.
+    if (0 == rc && undo) {
+      undo->log_update(db_name, table_name, old_obj);
+    }
+  } else {
+    get_write_cond(old_data, cond);
+    if (undo) {
+      undo->log_update(db_name, table_name, cur_rec);
+    }
+    rc = collection->update(rule_obj, cond, SDB_EMPTY_BSON,
+                            UPDATE_KEEP_SHARDINGKEY);
+  }
+  if (rc != 0) {
+    if (SDB_IXM_DUP_KEY == get_sdb_code(rc)) {
+      // convert to MySQL errcode
+      rc = HA_ERR_FOUND_DUPP_KEY;
+    }
+    goto error;
+  }
+
+  if (m_use_read_removal) {
+    m_read_removal_rows++;
+  }
+  if (m_use_lob) {
+    remove_row_lobs(rule_obj);
+  }
+
+done:
+  return rc;
+error:
+  remove_created_lobs(m_created_lobs);
+  goto done;
+}
+
+bool ha_sdb::start_bulk_delete() {
+  // Triggers may read the rows which have not been removed yet.
+  // And the LOBs of each row are removed after it's deleted.
+  if ((table->triggers && table->triggers->has_delete_triggers()) ||
+      m_use_lob) {
+    return true;
+  }
+
+  m_bulk_delete_oids.clear();
+  m_use_bulk_delete = true;
+  return false;
+}
+
+int ha_sdb::flush_bulk_delete() {
+  int rc = 0;
+  bson::BSONObj cond;
 
+  DBUG_ASSERT(m_bulk_delete_oids.size() > 0);
   DBUG_ASSERT(NULL != collection);
   DBUG_ASSERT(collection->thread_id() == ha_thd()->thread_id());
 
-  ha_statistic_increment(&SSV::ha_update_count);
-
-  rc = get_update_obj(old_data, new_data, new_obj, null_obj);
-  if (rc != 0) {
-    if (HA_ERR_UNKNOWN_CHARSET == rc && ha_thd()->lex->is_ignore()) {
-      rc = 0;
-    } else {
-      goto error;
-    }
+  sdb_build_oid_in_cond(m_bulk_delete_oids, cond);
+  rc = collection->del(cond, BSON("" << SDB_OID_INDEX));
+  if (0 == rc) {
+    stats.records -= m_bulk_delete_oids.size();
   }
+  m_bulk_delete_oids.clear();
+  return rc;
+}
 
-  if (null_obj.isEmpty()) {
-    rule_obj = BSON("$set" << new_obj);
-  } else {
-    rule_obj = BSON("$set" << new_obj << "$unset" << null_obj);
-  }
+int ha_sdb::end_bulk_delete() {
+  int rc = 0;
 
-  if (get_unique_key_cond(old_data, cond)) {
-    cond = cur_rec;
-  }
-  rc = collection->update(rule_obj, cond, SDB_EMPTY_BSON,
-                          UPDATE_KEEP_SHARDINGKEY);
-  if (rc != 0) {
-    if (SDB_IXM_DUP_KEY == get_sdb_code(rc)) {
-      // convert to MySQL errcode
-      rc = HA_ERR_FOUND_DUPP_KEY;
+  if (m_use_bulk_delete) {
+    m_use_bulk_delete = false;
+    if (m_bulk_delete_oids.size() > 0) {
+      rc = flush_bulk_delete();
     }
-    goto error;
   }
 
-done:
   return rc;
-error:
-  goto done;
 }
 
 int ha_sdb::delete_row(const uchar *buf) {
   int rc = 0;
   bson::BSONObj cond;
+  bson::BSONObj old_obj;
+  Sdb_conn *undo = NULL;
 
   DBUG_ASSERT(NULL != collection);
   DBUG_ASSERT(collection->thread_id() == ha_thd()->thread_id());
 
   ha_statistic_increment(&SSV::ha_delete_count);
 
-  if (get_unique_key_cond(buf, cond)) {
-    cond = cur_rec;
+  // The row of read removal is deleted by one atomic request, which needs
+  // no transaction if it's the only row of the statement.
+  if (!m_read_removal_row || !is_single_row_removal()) {
+    rc = ensure_transaction();
+    if (rc != 0) {
+      goto error;
+    }
+  }
+
+  undo = undo_log();
+  if (m_use_bulk_delete && !m_read_removal_row) {
+    // cur_rec is the row to be deleted, it is just read by the scan
+    bson::BSONElement be_oid;
+    if (cur_rec.getObjectID(be_oid) && bson::jstOID == be_oid.type()) {
+      if (undo) {
+        undo->log_delete(db_name, table_name, cur_rec);
+      }
+      m_bulk_delete_oids.push_back(be_oid.__oid());
+      if ((int)m_bulk_delete_oids.size() >= sdb_bulk_delete_size) {
+        rc = flush_bulk_delete();
+        if (rc != 0) {
+          goto error;
+        }
+      }
+      goto done;
+    }
+  }
+
+  if (m_read_removal_row) {
+    if (get_read_removal_cond(buf, cond)) {
+      rc = HA_ERR_INTERNAL_ERROR;
+      goto error;
+    }
+    rc = collection->query_and_remove_one(
+        cond, BSON("" << table->key_info[active_index].name),
+        QUERY_WITH_RETURNDATA, undo ? &old_obj : NULL);
+    if (HA_ERR_END_OF_FILE == rc) {
+      // the row doesn't exist, nothing is deleted
+      rc = 0;
+      goto done;
+    }
+    if (0 == rc && undo) {
+      undo->log_delete(db_name, table_name, old_obj);
+    }
+  } else {
+    get_write_cond(buf, cond);
+    if (undo) {
+      undo->log_delete(db_name, table_name, cur_rec);
+    }
+    rc = collection->del(cond);
   }
-  rc = collection->del(cond);
   if (rc != 0) {
     goto error;
   }
 
+  if (m_use_read_removal) {
+    m_read_removal_rows++;
+  }
+  if (m_use_lob) {
+    remove_row_lobs(SDB_EMPTY_BSON);
+  }
   stats.records--;
 
 done:
@@ -843,6 +2186,13 @@ int ha_sdb::index_next(uchar *buf) {
 
   ha_statistic_increment(&SSV::ha_read_next_count);
 
+  if (m_read_removal_row) {
+    // at most one row is matched by a unique key
+    table->status = STATUS_NOT_FOUND;
+    rc = HA_ERR_END_OF_FILE;
+    goto done;
+  }
+
   rc = next_row(cur_rec, buf);
   if (rc != 0) {
     goto error;
@@ -909,6 +2259,22 @@ int ha_sdb::index_read_map(uchar *buf, const uchar *key_ptr,
 
   ha_statistic_increment(&SSV::ha_read_key_count);
 
+  m_read_removal_row = false;
+  if (m_use_read_removal && NULL != key_ptr && active_index < MAX_KEY &&
+      HA_READ_KEY_EXACT == find_flag && can_remove_read(key_ptr, keypart_map)) {
+    /*
+      The row is identified by the unique key, and the following write is
+      going to match it by the key too. Don't fetch it, fill the key fields
+      into the row instead.
+    */
+    KEY *key_info = table->key_info + active_index;
+    key_restore(buf, const_cast<uchar *>(key_ptr), key_info,
+                calculate_key_len(table, active_index, keypart_map));
+    m_read_removal_row = true;
+    table->status = 0;
+    goto done;
+  }
+
   if (NULL != key_ptr && active_index < MAX_KEY) {
     KEY *key_info = table->key_info + active_index;
     key_range start_key;
@@ -919,7 +2285,7 @@ int ha_sdb::index_read_map(uchar *buf, const uchar *key_ptr,
 
     rc = sdb_create_condition_from_key(table, key_info, &start_key, end_range,
                                        0, (NULL != end_range) ? eq_range : 0,
-                                       condition_idx);
+                                       m_datetime_as_int64, condition_idx);
     if (0 != rc) {
       SDB_LOG_ERROR("Fail to build index match object. rc: %d", rc);
       goto error;
@@ -950,6 +2316,30 @@ error:
   goto done;
 }
 
+/*
+  The read can be removed only when the key matches at most one row, which
+  means all parts of the unique key are given and none of them is NULL.
+*/
+bool ha_sdb::can_remove_read(const uchar *key_ptr, key_part_map keypart_map) {
+  const KEY *key_info = table->key_info + active_index;
+  const KEY_PART_INFO *key_part = key_info->key_part;
+  const KEY_PART_INFO *key_end = key_part + key_info->user_defined_key_parts;
+  const uchar *key_pos = key_ptr;
+
+  if (!(key_info->flags & HA_NOSAME) ||
+      keypart_map != make_prev_keypart_map(key_info->user_defined_key_parts)) {
+    return false;
+  }
+
+  for (; key_part != key_end; ++key_part) {
+    if (key_part->null_bit && *key_pos) {
+      return false;
+    }
+    key_pos += key_part->store_length;
+  }
+  return true;
+}
+
 int ha_sdb::index_read_one(bson::BSONObj condition, int order_direction,
                            uchar *buf) {
   int rc = 0;
@@ -973,6 +2363,13 @@ int ha_sdb::index_read_one(bson::BSONObj condition, int order_direction,
   }
 
   flag = get_query_flag(thd_sql_command(ha_thd()), m_lock_type);
+  if ((flag & (QUERY_FOR_UPDATE | SDB_QUERY_FOR_SHARE)) ||
+      m_semi_consistent_read) {
+    rc = ensure_transaction();
+    if (rc) {
+      goto error;
+    }
+  }
   rc =
       collection->query(condition, SDB_EMPTY_BSON, order_by, hint, 0, -1, flag);
   if (rc) {
@@ -1016,6 +2413,7 @@ int ha_sdb::index_init(uint idx, bool sorted) {
     pushed_condition = SDB_EMPTY_BSON;
   }
   free_root(&blobroot, MYF(0));
+  release_pinned_rows();
   return 0;
 }
 
@@ -1033,6 +2431,7 @@ int ha_sdb::rnd_init(bool scan) {
     pushed_condition = SDB_EMPTY_BSON;
   }
   free_root(&blobroot, MYF(0));
+  release_pinned_rows();
   return 0;
 }
 
@@ -1045,6 +2444,7 @@ int ha_sdb::rnd_end() {
 
 int ha_sdb::obj_to_row(bson::BSONObj &obj, uchar *buf) {
   int rc = SDB_ERR_OK;
+  MEM_ROOT *blob_root = &blobroot;
   THD *thd = table->in_use;
   my_bool is_select = (SQLCOM_SELECT == thd_sql_command(thd));
   memset(buf, 0, table->s->null_bytes);
@@ -1072,6 +2472,20 @@ int ha_sdb::obj_to_row(bson::BSONObj &obj, uchar *buf) {
     goto error;
   }
 
+  // LOBs may be huge, so only those of current row are kept, like InnoDB
+  // does with its blob heap.
+  if (m_use_lob) {
+    free_root(&m_lob_root, MYF(0));
+  }
+
+  // BLOB refers to the owned object directly, which is pinned in a ring so
+  // that it's alive as long as MySQL may use the record.
+  if (table->s->blob_fields > 0 && obj.isOwned()) {
+    m_pinned_rows[m_pinned_row_idx] = obj;
+    m_pinned_row_idx = (m_pinned_row_idx + 1) % SDB_PINNED_ROW_COUNT;
+    blob_root = NULL;
+  }
+
   for (Field **fields = table->field; *fields; fields++) {
     Field *field = *fields;
     bson::BSONElement elem;
@@ -1115,7 +2529,27 @@ int ha_sdb::obj_to_row(bson::BSONObj &obj, uchar *buf) {
       continue;
     }
 
-    rc = bson_element_to_field(elem, field);
+    if (bson::jstOID == elem.type() && MYSQL_TYPE_BLOB == field->type()) {
+      // The value is stored in LOB, which is fetched only when it's used.
+      // The written one is fetched too, or it may be taken as unchanged.
+      if (bitmap_is_set(table->read_set, field->field_index) ||
+          bitmap_is_set(table->write_set, field->field_index)) {
+        rc = read_lob(elem, field);
+        if (0 != rc) {
+          goto error;
+        }
+      }
+      continue;
+    }
+
+    const Sdb_field_decoder &decoder = m_row_decoder[field->field_index];
+    rc = SDB_ERR_TYPE_UNSUPPORTED;
+    if (NULL != decoder.decode) {
+      rc = decoder.decode(elem, decoder, field->ptr, blob_root);
+    }
+    if (SDB_ERR_TYPE_UNSUPPORTED == rc) {
+      rc = bson_element_to_field(elem, field);
+    }
     if (0 != rc) {
       goto error;
     }
@@ -1130,16 +2564,41 @@ error:
   goto done;
 }
 
+void ha_sdb::release_pinned_rows() {
+  for (uint i = 0; i < SDB_PINNED_ROW_COUNT; ++i) {
+    m_pinned_rows[i] = SDB_EMPTY_BSON;
+  }
+  m_pinned_row_idx = 0;
+}
+
 int ha_sdb::bson_element_to_field(const bson::BSONElement elem, Field *field) {
   int rc = SDB_ERR_OK;
 
   DBUG_ASSERT(0 == strcmp(elem.fieldName(), field->field_name));
 
+  if (MYSQL_TYPE_JSON == field->type() && bson::BinData != elem.type()) {
+    // JSON stored as native BSON
+    Json_dom *dom = NULL;
+    rc = sdb_bson_to_json(elem, dom);
+    if (0 != rc) {
+      goto error;
+    }
+    Json_wrapper wr(dom);
+    ((Field_json *)field)->store_json(&wr);
+    rc = keep_blob_value(field);
+    goto done;
+  }
+
   switch (elem.type()) {
     case bson::NumberInt:
     case bson::NumberLong: {
       longlong nr = elem.numberLong();
-      field->store(nr, false);
+      if (MYSQL_TYPE_DATETIME == field->type()) {
+        // datetime is stored as packed int64
+        field->store_packed(nr);
+      } else {
+        field->store(nr, false);
+      }
       break;
     }
     case bson::NumberDouble: {
@@ -1166,6 +2625,12 @@ int ha_sdb::bson_element_to_field(const bson::BSONElement elem, Field *field) {
       break;
     }
     case bson::NumberDecimal: {
+      my_decimal dec_val;
+      if (STRING_RESULT != field->result_type() &&
+          0 == sdb_bson_value_to_decimal(elem.value(), &dec_val)) {
+        field->store_decimal(&dec_val);
+        break;
+      }
       bson::bsonDecimal valTmp = elem.numberDecimal();
       string strValTmp = valTmp.toString();
       field->store(strValTmp.c_str(), strValTmp.length(), &my_charset_bin);
@@ -1173,17 +2638,9 @@ int ha_sdb::bson_element_to_field(const bson::BSONElement elem, Field *field) {
     }
     case bson::Date: {
       MYSQL_TIME time_val;
-      struct timeval tv;
-      struct tm tm_val;
-
       longlong millisec = (longlong)(elem.date());
-      tv.tv_sec = millisec / 1000;
-      tv.tv_usec = millisec % 1000 * 1000;
-      localtime_r((const time_t *)(&tv.tv_sec), &tm_val);
-
-      time_val.year = tm_val.tm_year + 1900;
-      time_val.month = tm_val.tm_mon + 1;
-      time_val.day = tm_val.tm_mday;
+      sdb_localtime_date((time_t)(millisec / 1000), time_val.year,
+                         time_val.month, time_val.day);
       time_val.hour = 0;
       time_val.minute = 0;
       time_val.second = 0;
@@ -1219,18 +2676,36 @@ int ha_sdb::bson_element_to_field(const bson::BSONElement elem, Field *field) {
       goto error;
   }
   if (field->flags & BLOB_FLAG) {
-    Field_blob *blob = (Field_blob *)field;
-    uchar *src, *dst;
-    uint length, packlength;
+    rc = keep_blob_value(field);
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
 
-    packlength = blob->pack_length_no_ptr();
-    length = blob->get_length(blob->ptr);
-    memcpy(&src, blob->ptr + packlength, sizeof(char *));
-    if (src) {
-      dst = (uchar *)alloc_root(&blobroot, length);
-      memmove(dst, src, length);
-      memcpy(blob->ptr + packlength, &dst, sizeof(char *));
+/*
+  The value stored into BLOB is in the buffer of field, which is overwritten
+  by the next row, so copy it to blobroot.
+*/
+int ha_sdb::keep_blob_value(Field *field, MEM_ROOT *root) {
+  int rc = 0;
+  Field_blob *blob = (Field_blob *)field;
+  uchar *src, *dst;
+  uint length, packlength;
+
+  packlength = blob->pack_length_no_ptr();
+  length = blob->get_length(blob->ptr);
+  memcpy(&src, blob->ptr + packlength, sizeof(char *));
+  if (src) {
+    dst = (uchar *)alloc_root(NULL == root ? &blobroot : root, length);
+    if (NULL == dst) {
+      rc = HA_ERR_OUT_OF_MEM;
+      goto error;
     }
+    memmove(dst, src, length);
+    memcpy(blob->ptr + packlength, &dst, sizeof(char *));
   }
 
 done:
@@ -1267,6 +2742,19 @@ int ha_sdb::next_row(bson::BSONObj &obj, uchar *buf) {
   DBUG_ASSERT(NULL != collection);
   DBUG_ASSERT(collection->thread_id() == ha_thd()->thread_id());
 
+  // The last row matched the condition, it's to be updated.
+  if (m_did_semi_consistent_read) {
+    m_did_semi_consistent_read = false;
+    rc = lock_cur_row(obj, buf);
+    if (0 == rc) {
+      table->status = 0;
+      goto done;
+    }
+    if (rc != HA_ERR_KEY_NOT_FOUND) {
+      goto error;
+    }
+  }
+
   rc = collection->next(obj);
   if (rc != 0) {
     if (HA_ERR_END_OF_FILE == rc) {
@@ -1281,6 +2769,7 @@ int ha_sdb::next_row(bson::BSONObj &obj, uchar *buf) {
   }
 
   table->status = 0;
+  m_did_semi_consistent_read = m_semi_consistent_read && !m_use_read_removal;
 
 done:
   return rc;
@@ -1296,6 +2785,13 @@ int ha_sdb::rnd_next(uchar *buf) {
 
   if (first_read) {
     int flag = get_query_flag(thd_sql_command(ha_thd()), m_lock_type);
+    if ((flag & (QUERY_FOR_UPDATE | SDB_QUERY_FOR_SHARE)) ||
+        m_semi_consistent_read) {
+      rc = ensure_transaction();
+      if (rc != 0) {
+        goto error;
+      }
+    }
     rc = collection->query(pushed_condition, SDB_EMPTY_BSON, SDB_EMPTY_BSON,
                            SDB_EMPTY_BSON, 0, -1, flag);
     if (rc != 0) {
@@ -1378,7 +2874,19 @@ int ha_sdb::info(uint flag) {
   }
 
   if (flag & HA_STATUS_AUTO) {
-    stats.auto_increment_value = 0;
+    ulonglong next = 0;
+    if (table->found_next_number_field && share) {
+      if (my_atomic_load64(&share->auto_inc_end) > 0) {
+        next = (ulonglong)my_atomic_load64(&share->auto_inc_next);
+      } else if (0 != sdb_seq_get(db_name, table_name, next)) {
+        next = 0;
+      }
+    }
+    stats.auto_increment_value = next;
+  }
+
+  if (flag & HA_STATUS_ERRKEY) {
+    errkey = m_dup_key_nr;
   }
 
 done:
@@ -1443,8 +2951,46 @@ error:
   goto done;
 }
 
+bool ha_sdb::start_read_removal() {
+  // The before image of a row-based binlog event needs the whole row, and
+  // the LOBs to remove are known only from the fetched row.
+  if (sdb_is_row_binlogged(ha_thd()) || m_use_lob) {
+    return false;
+  }
+
+  m_use_read_removal = true;
+  m_read_removal_row = false;
+  m_read_removal_rows = 0;
+  // ha_table_flags() returns the cached flags, refresh them.
+  cached_table_flags = table_flags();
+  return true;
+}
+
+ha_rows ha_sdb::end_read_removal() {
+  DBUG_ASSERT(m_use_read_removal);
+  m_use_read_removal = false;
+  m_read_removal_row = false;
+  cached_table_flags = table_flags();
+  return m_read_removal_rows;
+}
+
 int ha_sdb::extra(enum ha_extra_function operation) {
-  // TODO: extra hints
+  switch (operation) {
+    case HA_EXTRA_WRITE_CAN_REPLACE:
+      m_write_can_replace = init_upsert_key();
+      break;
+    case HA_EXTRA_WRITE_CANNOT_REPLACE:
+      m_write_can_replace = false;
+      break;
+    case HA_EXTRA_INSERT_WITH_UPDATE:
+      m_insert_with_update = init_upsert_key() && init_upsert_fields();
+      break;
+    case HA_EXTRA_NO_IGNORE_DUP_KEY:
+      m_insert_with_update = false;
+      break;
+    default:
+      break;
+  }
   return 0;
 }
 
@@ -1503,23 +3049,17 @@ int ha_sdb::start_statement(THD *thd, uint table_count) {
     }
     DBUG_ASSERT(conn->thread_id() == thd->thread_id());
 
+    // The transaction of autocommit is begun by ensure_transaction().
     if (thd_test_options(thd, OPTION_NOT_AUTOCOMMIT | OPTION_BEGIN)) {
       if (!conn->is_transaction_on()) {
-        rc = conn->begin_transaction();
+        rc = conn->begin_transaction(sdb_tx_isolation(thd), true);
         if (rc != 0) {
           goto error;
         }
         trans_register_ha(thd, TRUE, ht, NULL);
       }
-    } else {
-      // autocommit
-      if (sdb_use_autocommit && !conn->is_transaction_on()) {
-        rc = conn->begin_transaction();
-        if (rc != 0) {
-          goto error;
-        }
-        trans_register_ha(thd, FALSE, ht, NULL);
-      }
+      // The statement is registered too, so that it can be rolled back alone.
+      trans_register_ha(thd, FALSE, ht, NULL);
     }
   } else {
     // there is more than one handler involved
@@ -1531,6 +3071,50 @@ error:
   goto done;
 }
 
+/*
+  The transaction of an autocommit statement is begun lazily by its first
+  write or locking read, so that read-only statements run without one.
+*/
+int ha_sdb::ensure_transaction() {
+  int rc = 0;
+  THD *thd = ha_thd();
+  Sdb_conn *conn = NULL;
+
+  DBUG_ASSERT(NULL != collection);
+
+  if (!sdb_use_autocommit || collection->is_transaction_on() ||
+      thd_test_options(thd, OPTION_NOT_AUTOCOMMIT | OPTION_BEGIN)) {
+    goto done;
+  }
+
+  conn = check_sdb_in_thd(thd, true);
+  if (NULL == conn) {
+    rc = HA_ERR_NO_CONNECTION;
+    goto error;
+  }
+  DBUG_ASSERT(conn->thread_id() == thd->thread_id());
+
+  rc = conn->begin_transaction(sdb_tx_isolation(thd));
+  if (rc != 0) {
+    goto error;
+  }
+  trans_register_ha(thd, FALSE, ht, NULL);
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+/*
+  The connection if the changes are logged to be undone, or NULL. See
+  Sdb_conn::is_undo_on().
+*/
+Sdb_conn *ha_sdb::undo_log() {
+  Sdb_conn *conn = check_sdb_in_thd(ha_thd());
+  return (NULL != conn && conn->is_undo_on()) ? conn : NULL;
+}
+
 int ha_sdb::external_lock(THD *thd, int lock_type) {
   int rc = 0;
   Thd_sdb *thd_sdb = NULL;
@@ -1753,60 +3337,278 @@ bool ha_sdb::inplace_alter_table(TABLE *altered_table,
     }
   }
 
-  if (ha_alter_info->handler_flags & INPLACE_ONLINE_DROPIDX) {
-    rc = drop_index(cl, ha_alter_info, ignored_drop_keys);
-    if (0 != rc) {
-      my_error(ER_GET_ERRNO, MYF(0), rc);
-      goto error;
+  if (ha_alter_info->handler_flags & INPLACE_ONLINE_DROPIDX) {
+    rc = drop_index(cl, ha_alter_info, ignored_drop_keys);
+    if (0 != rc) {
+      my_error(ER_GET_ERRNO, MYF(0), rc);
+      goto error;
+    }
+  }
+
+  if (ha_alter_info->handler_flags & INPLACE_ONLINE_ADDIDX) {
+    rc = create_index(cl, ha_alter_info, ignored_add_keys);
+    if (0 != rc) {
+      my_error(ER_GET_ERRNO, MYF(0), rc);
+      goto error;
+    }
+  }
+
+  if (ha_alter_info->handler_flags & Alter_inplace_info::RENAME_INDEX) {
+    my_error(HA_ERR_UNSUPPORTED, MYF(0), cl.get_cl_name());
+    goto error;
+  }
+
+  rs = false;
+
+done:
+  return rs;
+error:
+  goto done;
+}
+
+/*
+  AUTO_INCREMENT values are handed out from the range reserved by this SQL
+  node without lock, by CAS on share->auto_inc_next. A new range is reserved
+  from the sequence of the table under share->mutex.
+*/
+static void sdb_set_auto_inc_range(Sdb_share *share, ulonglong next,
+                                   ulonglong end) {
+  // A claim that has read the old next fails its CAS after next is stored,
+  // and one that reads the new next reads end after it, so a claimed value
+  // never spans the old and new ranges.
+  my_atomic_store64(&share->auto_inc_end, 0);
+  my_atomic_store64(&share->auto_inc_next, (int64)next);
+  my_atomic_store64(&share->auto_inc_end, (int64)end);
+}
+
+// The least value >= value in the series offset + N * increment.
+static inline ulonglong sdb_align_auto_inc(ulonglong value, ulonglong offset,
+                                           ulonglong increment) {
+  if (increment <= 1) {
+    return value;
+  }
+  if (value - 1 + increment < offset) {
+    return offset;
+  }
+  return (value - 1 + increment - offset) / increment * increment + offset;
+}
+
+int ha_sdb::delete_all_rows() {
+  int rc = 0;
+  DBUG_ASSERT(NULL != collection);
+  DBUG_ASSERT(collection->thread_id() == ha_thd()->thread_id());
+
+  rc = ensure_transaction();
+  if (rc != 0) {
+    return rc;
+  }
+
+  if (collection->is_transaction_on()) {
+    Sdb_conn *undo = undo_log();
+    // The removed rows are not kept.
+    if (undo) {
+      undo->lose_undo();
+    }
+    rc = collection->del();
+    if (0 == rc) {
+      stats.records = 0;
+    }
+    return rc;
+  }
+  return truncate();
+}
+
+/*
+  The AUTO_INCREMENT sequence isn't reset by TRUNCATE. Other SQL nodes keep
+  handing out their cached ranges, so values reserved again from 1 would
+  overlap them.
+*/
+int ha_sdb::truncate() {
+  int rc = 0;
+  DBUG_ASSERT(NULL != collection);
+  DBUG_ASSERT(collection->thread_id() == ha_thd()->thread_id());
+
+  rc = collection->truncate();
+  if (0 != rc) {
+    goto error;
+  }
+  stats.records = 0;
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+void ha_sdb::get_auto_increment(ulonglong offset, ulonglong increment,
+                                ulonglong nb_desired_values,
+                                ulonglong *first_value,
+                                ulonglong *nb_reserved_values) {
+  int rc = 0;
+  ulonglong count = nb_desired_values > 0 ? nb_desired_values : 1;
+
+  while (!claim_auto_inc(offset, increment, count, *first_value)) {
+    rc = reserve_auto_inc(count * increment);
+    if (0 != rc) {
+      SDB_LOG_ERROR("Failed to reserve AUTO_INCREMENT of %s.%s, rc=%d",
+                    db_name, table_name, rc);
+      *first_value = ULONGLONG_MAX;
+      return;
+    }
+  }
+  *nb_reserved_values = count;
+}
+
+bool ha_sdb::claim_auto_inc(ulonglong offset, ulonglong increment,
+                            ulonglong count, ulonglong &first) {
+  int64 next = my_atomic_load64(&share->auto_inc_next);
+  while (true) {
+    ulonglong end = (ulonglong)my_atomic_load64(&share->auto_inc_end);
+    ulonglong value = sdb_align_auto_inc(next, offset, increment);
+    ulonglong last = value + (count - 1) * increment;
+    if (0 == next || last >= end || last < value) {
+      return false;
+    }
+    // next is reloaded if it has been changed.
+    if (my_atomic_cas64(&share->auto_inc_next, &next, (int64)(last + 1))) {
+      first = value;
+      return true;
     }
   }
+}
 
-  if (ha_alter_info->handler_flags & INPLACE_ONLINE_ADDIDX) {
-    rc = create_index(cl, ha_alter_info, ignored_add_keys);
+int ha_sdb::reserve_auto_inc(ulonglong span) {
+  int rc = 0;
+  ulonglong first = 0;
+  ulonglong size = MY_MAX((ulonglong)sdb_auto_increment_cache_size, span);
+  Sdb_mutex_guard guard(share->mutex);
+
+  // Others may have reserved a range while waiting for the lock.
+  if (my_atomic_load64(&share->auto_inc_end) -
+          my_atomic_load64(&share->auto_inc_next) >=
+      (int64)span) {
+    goto done;
+  }
+
+  rc = sdb_seq_reserve(db_name, table_name, size, first);
+  if (HA_ERR_KEY_NOT_FOUND == rc) {
+    rc = init_auto_inc_seq();
     if (0 != rc) {
-      my_error(ER_GET_ERRNO, MYF(0), rc);
       goto error;
     }
+    rc = sdb_seq_reserve(db_name, table_name, size, first);
   }
-
-  if (ha_alter_info->handler_flags & Alter_inplace_info::RENAME_INDEX) {
-    my_error(HA_ERR_UNSUPPORTED, MYF(0), cl.get_cl_name());
+  if (0 != rc) {
     goto error;
   }
-
-  rs = false;
+  sdb_set_auto_inc_range(share, first, first + size);
 
 done:
-  return rs;
+  return rc;
 error:
   goto done;
 }
 
-int ha_sdb::delete_all_rows() {
+/*
+  Keep the values generated later above the value set explicitly. A value
+  beyond the range of this SQL node raises the sequence by a whole range,
+  which is taken as the new range, so that rows inserted with increasing
+  values, like those copied by ALTER TABLE, don't access the sequence per
+  row.
+*/
+int ha_sdb::raise_auto_inc(ulonglong value) {
   int rc = 0;
-  DBUG_ASSERT(NULL != collection);
-  DBUG_ASSERT(collection->thread_id() == ha_thd()->thread_id());
+  ulonglong size = sdb_auto_increment_cache_size;
+  ulonglong old_next = 0;
+  int64 next = my_atomic_load64(&share->auto_inc_next);
+  int64 end = my_atomic_load64(&share->auto_inc_end);
 
-  if (collection->is_transaction_on()) {
-    rc = collection->del();
-    if (0 == rc) {
-      stats.records = 0;
+  // Values too large to raise can't be generated either.
+  if (value >= (ulonglong)LONGLONG_MAX - size) {
+    goto done;
+  }
+
+  if ((int64)value < end) {
+    // Values of this range are not handed out by other SQL nodes.
+    while ((int64)value >= next &&
+           !my_atomic_cas64(&share->auto_inc_next, &next, (int64)value + 1)) {
     }
-    return rc;
+    goto done;
   }
-  return truncate();
+
+  {
+    Sdb_mutex_guard guard(share->mutex);
+    rc = sdb_seq_raise(db_name, table_name, value + 1 + size, old_next);
+    if (HA_ERR_KEY_NOT_FOUND == rc) {
+      rc = init_auto_inc_seq();
+      if (0 != rc) {
+        goto error;
+      }
+      rc = sdb_seq_raise(db_name, table_name, value + 1 + size, old_next);
+    }
+    if (0 != rc) {
+      goto error;
+    }
+    // Values below old_next may have been reserved by others.
+    if (old_next > 0) {
+      sdb_set_auto_inc_range(share, MY_MAX(old_next, value + 1),
+                             value + 1 + size);
+    }
+  }
+
+done:
+  return rc;
+error:
+  SDB_LOG_ERROR("Failed to raise AUTO_INCREMENT of %s.%s, rc=%d", db_name,
+                table_name, rc);
+  goto done;
 }
 
-int ha_sdb::truncate() {
+int ha_sdb::raise_auto_inc_by_row(const uchar *row) {
+  Field *field = table->found_next_number_field;
+  longlong value = 0;
+
+  if (NULL == field ||
+      !bitmap_is_set(table->write_set, field->field_index)) {
+    return 0;
+  }
+  value = field->val_int_offset(row - table->record[0]);
+  if (0 == value || (value < 0 && !field->is_unsigned())) {
+    return 0;
+  }
+  return raise_auto_inc((ulonglong)value);
+}
+
+/*
+  The table created before AUTO_INCREMENT is supported has no sequence
+  record, which starts from the max value of the table.
+*/
+int ha_sdb::init_auto_inc_seq() {
   int rc = 0;
-  DBUG_ASSERT(NULL != collection);
-  DBUG_ASSERT(collection->thread_id() == ha_thd()->thread_id());
+  bson::BSONObj obj;
+  ulonglong next = 1;
+  const char *field_name = table->found_next_number_field->field_name;
 
-  rc = collection->truncate();
+  rc = collection->query_one(obj, SDB_EMPTY_BSON, SDB_EMPTY_BSON,
+                             BSON(field_name << -1));
   if (0 == rc) {
-    stats.records = 0;
+    bson::BSONElement elem = obj.getField(field_name);
+    if (elem.isNumber() && elem.numberLong() > 0) {
+      next = (ulonglong)elem.numberLong() + 1;
+    }
+  } else if (SDB_DMS_EOC != get_sdb_code(rc)) {
+    goto error;
+  }
+
+  rc = sdb_seq_init(db_name, table_name, next);
+  if (0 != rc) {
+    goto error;
   }
+
+done:
   return rc;
+error:
+  goto done;
 }
 
 int ha_sdb::analyze(THD *thd, HA_CHECK_OPT *check_opt) {
@@ -1848,6 +3650,13 @@ int ha_sdb::delete_table(const char *from) {
     goto error;
   }
 
+  // The sequence record left is only garbage, which is replaced by the table
+  // created with the same name.
+  if (0 != sdb_seq_remove(db_name, table_name)) {
+    SDB_LOG_WARNING("Failed to remove AUTO_INCREMENT of %s.%s", db_name,
+                    table_name);
+  }
+
 done:
   return rc;
 error:
@@ -1906,66 +3715,92 @@ int ha_sdb::rename_table(const char *from, const char *to) {
     goto error;
   }
 
+  // The table without sequence record starts from its max value.
+  if (0 != sdb_seq_rename(old_db_name, old_table_name, new_table_name)) {
+    SDB_LOG_WARNING("Failed to rename AUTO_INCREMENT of %s.%s", old_db_name,
+                    old_table_name);
+  }
+
 done:
   return rc;
 error:
   goto done;
 }
 
-int ha_sdb::get_sharding_key(TABLE *form, bson::BSONObj &sharding_key) {
+int ha_sdb::get_sharding_key(TABLE *form, const bson::BSONObj &specified_key,
+                             bson::BSONObj &sharding_key) {
   int rc = 0;
   const KEY *shard_idx = NULL;
-
-  for (uint i = 0; i < form->s->keys; i++) {
-    const KEY *key_info = form->s->key_info + i;
-    if (!strcmp(key_info->name, primary_key_name)) {
-      shard_idx = key_info;
-      break;
-    }
-    if (NULL == shard_idx && (key_info->flags & HA_NOSAME)) {
-      shard_idx = key_info;
+  bson::BSONObjBuilder sharding_key_builder;
+
+  if (!specified_key.isEmpty()) {
+    bson::BSONObjIterator it(specified_key);
+    while (it.more()) {
+      bson::BSONElement elem = it.next();
+      Field **field = form->field;
+      while (*field && 0 != my_strcasecmp(system_charset_info,
+                                          (*field)->field_name,
+                                          elem.fieldName())) {
+        field++;
+      }
+      if (NULL == *field) {
+        rc = SDB_ERR_INVALID_ARG;
+        SDB_PRINT_ERROR(rc, "The sharding key field '%-.192s' doesn't exist",
+                        elem.fieldName());
+        goto error;
+      }
+      sharding_key_builder.append((*field)->field_name,
+                                  elem.numberInt() < 0 ? -1 : 1);
     }
-  }
-  if (NULL != shard_idx) {
-    bson::BSONObjBuilder sharding_key_builder;
-    const KEY_PART_INFO *key_part;
-    const KEY_PART_INFO *key_end;
-
-    // check unique-idx if include sharding-key
+  } else {
     for (uint i = 0; i < form->s->keys; i++) {
       const KEY *key_info = form->s->key_info + i;
-      if ((key_info->flags & HA_NOSAME) && key_info != shard_idx) {
-        key_part = shard_idx->key_part;
-        key_end = key_part + shard_idx->user_defined_key_parts;
-        for (; key_part != key_end; ++key_part) {
-          const KEY_PART_INFO *key_part_tmp = key_info->key_part;
-          const KEY_PART_INFO *key_end_tmp =
-              key_part_tmp + key_info->user_defined_key_parts;
-          for (; key_part_tmp != key_end_tmp; ++key_part_tmp) {
-            if (0 == strcmp(key_part->field->field_name,
-                            key_part_tmp->field->field_name)) {
-              break;
-            }
-          }
+      if (!strcmp(key_info->name, primary_key_name)) {
+        shard_idx = key_info;
+        break;
+      }
+      if (NULL == shard_idx && (key_info->flags & HA_NOSAME)) {
+        shard_idx = key_info;
+      }
+    }
+    if (NULL != shard_idx) {
+      const KEY_PART_INFO *key_part = shard_idx->key_part;
+      const KEY_PART_INFO *key_end =
+          key_part + shard_idx->user_defined_key_parts;
+      for (; key_part != key_end; ++key_part) {
+        sharding_key_builder.append(key_part->field->field_name, 1);
+      }
+    }
+  }
+  sharding_key = sharding_key_builder.obj();
 
-          if (key_part_tmp == key_end_tmp) {
-            rc = SDB_ERR_INVALID_ARG;
-            SDB_PRINT_ERROR(
-                rc,
-                "The unique index('%-.192s') must include the field: '%-.192s'",
-                key_info->name, key_part->field->field_name);
-            goto error;
-          }
+  // check unique-idx if include sharding-key, so that the condition of
+  // unique key is sent to only one group.
+  for (uint i = 0; i < form->s->keys; i++) {
+    const KEY *key_info = form->s->key_info + i;
+    if (!(key_info->flags & HA_NOSAME)) {
+      continue;
+    }
+    bson::BSONObjIterator it(sharding_key);
+    while (it.more()) {
+      const char *field_name = it.next().fieldName();
+      const KEY_PART_INFO *key_part = key_info->key_part;
+      const KEY_PART_INFO *key_end =
+          key_part + key_info->user_defined_key_parts;
+      for (; key_part != key_end; ++key_part) {
+        if (0 == strcmp(field_name, key_part->field->field_name)) {
+          break;
         }
       }
-    }
 
-    key_part = shard_idx->key_part;
-    key_end = key_part + shard_idx->user_defined_key_parts;
-    for (; key_part != key_end; ++key_part) {
-      sharding_key_builder.append(key_part->field->field_name, 1);
+      if (key_part == key_end) {
+        rc = SDB_ERR_INVALID_ARG;
+        SDB_PRINT_ERROR(
+            rc, "The unique index('%-.192s') must include the field: '%-.192s'",
+            key_info->name, field_name);
+        goto error;
+      }
     }
-    sharding_key = sharding_key_builder.obj();
   }
 
 done:
@@ -1978,41 +3813,63 @@ int ha_sdb::get_cl_options(TABLE *form, HA_CREATE_INFO *create_info,
                            bson::BSONObj &options, my_bool use_partition) {
   int rc = 0;
   bson::BSONObj sharding_key;
+  bson::BSONObj specified_key;
+  bool is_hash = false;
+  int partition = 0;
 
   if (create_info && create_info->comment.str) {
-    char *sdb_cmt_pos = NULL;
     bson::BSONElement be_options;
     bson::BSONObj comments;
-    if ((sdb_cmt_pos = strstr(create_info->comment.str, SDB_COMMENT)) == NULL) {
-      goto comment_done;
-    }
-
-    sdb_cmt_pos += strlen(SDB_COMMENT);
-    while (*sdb_cmt_pos != '\0' && my_isspace(&SDB_CHARSET, *sdb_cmt_pos)) {
-      sdb_cmt_pos++;
-    }
+    bool datetime_as_int64 = false;
+    ulonglong lob_threshold = 0;
 
-    if (*sdb_cmt_pos != ':') {
-      rc = SDB_ERR_INVALID_ARG;
+    rc = sdb_parse_comment_options(create_info->comment.str, comments);
+    if (0 != rc) {
       my_printf_error(rc, "Failed to parse comment: '%-.192s'", MYF(0),
                       create_info->comment.str);
       goto error;
     }
 
-    sdb_cmt_pos += 1;
-    while (*sdb_cmt_pos != '\0' && my_isspace(&SDB_CHARSET, *sdb_cmt_pos)) {
-      sdb_cmt_pos++;
+    rc = sdb_get_datetime_format(comments, datetime_as_int64);
+    if (0 != rc) {
+      my_printf_error(rc,
+                      "Invalid datetime_format, it should be "
+                      "\"string\" or \"int64\"",
+                      MYF(0));
+      goto error;
+    }
+
+    rc = sdb_get_lob_threshold(comments, lob_threshold);
+    if (0 != rc) {
+      my_printf_error(rc, "Invalid lob_threshold, it should be bytes >= 0",
+                      MYF(0));
+      goto error;
     }
 
-    rc = bson::fromjson(sdb_cmt_pos, comments);
+    rc = sdb_get_sharding_options(comments, specified_key, is_hash,
+                                  partition);
     if (0 != rc) {
-      my_printf_error(rc, "Failed to parse comment: '%-.192s'", MYF(0),
-                      create_info->comment.str);
+      my_printf_error(rc,
+                      "Invalid sharding options, sharding_key should be "
+                      "{<field>: 1, ...}, sharding_type \"range\" or "
+                      "\"hash\", and partition of hash a power of 2 in "
+                      "[8, 1048576]",
+                      MYF(0));
       goto error;
     }
 
     be_options = comments.getField("table_options");
     if (be_options.type() == bson::Object) {
+      // table_options is passed as it is, the sharding options would be lost.
+      if (!specified_key.isEmpty() || is_hash || partition > 0) {
+        rc = SDB_ERR_INVALID_ARG;
+        my_printf_error(rc,
+                        "table_options can't be used with sharding_key, "
+                        "sharding_type or partition, specify the sharding "
+                        "in one of them",
+                        MYF(0));
+        goto error;
+      }
       options = be_options.embeddedObject().copy();
       goto done;
     } else if (be_options.type() != bson::EOO) {
@@ -2021,25 +3878,41 @@ int ha_sdb::get_cl_options(TABLE *form, HA_CREATE_INFO *create_info,
       goto error;
     }
   }
-comment_done:
-  if (!use_partition) {
+  // The sharding specified by the table is always taken.
+  if (!use_partition && specified_key.isEmpty() && !is_hash) {
     options = BSON("Compressed" << true << "CompressionType"
                                 << "lzw"
                                 << "ReplSize" << sdb_replica_size);
     goto done;
   }
 
-  rc = get_sharding_key(form, sharding_key);
+  rc = get_sharding_key(form, specified_key, sharding_key);
   if (rc != 0) {
     goto error;
   }
 
   if (!sharding_key.isEmpty()) {
-    options = BSON("ShardingKey" << sharding_key << "AutoSplit" << true
-                                 << "EnsureShardingIndex" << false
-                                 << "Compressed" << true << "CompressionType"
-                                 << "lzw"
-                                 << "ReplSize" << sdb_replica_size);
+    bson::BSONObjBuilder builder;
+    builder.append("ShardingKey", sharding_key);
+    if (is_hash) {
+      builder.append("ShardingType", "hash");
+      if (partition > 0) {
+        builder.append("Partition", partition);
+      }
+    }
+    builder.append("AutoSplit", true);
+    builder.append("EnsureShardingIndex", false);
+    builder.append("Compressed", true);
+    builder.append("CompressionType", "lzw");
+    builder.append("ReplSize", sdb_replica_size);
+    options = builder.obj();
+  } else if (is_hash) {
+    rc = SDB_ERR_INVALID_ARG;
+    my_printf_error(rc,
+                    "Hash sharding needs a primary key, a unique key or "
+                    "sharding_key",
+                    MYF(0));
+    goto error;
   } else {
     options = BSON("Compressed" << true << "CompressionType"
                                 << "lzw"
@@ -2076,12 +3949,6 @@ int ha_sdb::create(const char *name, TABLE *form, HA_CREATE_INFO *create_info) {
       rc = HA_WRONG_CREATE_OPTION;
       goto error;
     }
-
-    if (Field::NEXT_NUMBER == field->unireg_check) {
-      // TODO: support auto-increment field.
-      //      it is auto-increment field if run here.
-      //      the start-value is create_info->auto_increment_value
-    }
   }
 
   rc = sdb_parse_table_name(name, db_name, SDB_CS_NAME_MAX_SIZE, table_name,
@@ -2097,6 +3964,15 @@ int ha_sdb::create(const char *name, TABLE *form, HA_CREATE_INFO *create_info) {
     }
   }
 
+  // The generic partition handler generates AUTO_INCREMENT values by its
+  // counter in memory, which isn't shared by SQL nodes as the sequence is.
+  if (form->found_next_number_field && strstr(table_name, SDB_PART_SEP)) {
+    my_error(ER_NOT_SUPPORTED_YET, MYF(0),
+             "AUTO_INCREMENT of partitioned table in SequoiaDB");
+    rc = HA_WRONG_CREATE_OPTION;
+    goto error;
+  }
+
   rc = get_cl_options(form, create_info, options, sdb_use_partition);
   if (0 != rc) {
     goto error;
@@ -2128,6 +4004,14 @@ int ha_sdb::create(const char *name, TABLE *form, HA_CREATE_INFO *create_info) {
     }
   }
 
+  if (form->found_next_number_field) {
+    rc = sdb_seq_set(db_name, table_name,
+                     MY_MAX(create_info->auto_increment_value, 1ULL));
+    if (0 != rc) {
+      goto error;
+    }
+  }
+
 done:
   return rc;
 error:
@@ -2154,23 +4038,89 @@ THR_LOCK_DATA **ha_sdb::store_lock(THD *thd, THR_LOCK_DATA **to,
 void ha_sdb::unlock_row() {
   // TODO: this operation is not supported in sdb.
   //       unlock by _id or completed-record?
+
+  // The row of semi-consistent read doesn't match, so it's not read again.
+  m_did_semi_consistent_read = false;
+}
+
+/*
+  Semi-consistent read of UPDATE in READ COMMITTED or lower. The scan reads
+  the last committed rows without lock, and only the rows matching the
+  condition are read again with lock by the next call of next_row(), so that
+  the rows not to be updated are never locked nor waited for.
+*/
+void ha_sdb::try_semi_consistent_read(bool yes) {
+  m_semi_consistent_read =
+      yes && thd_tx_isolation(ha_thd()) <= ISO_READ_COMMITTED;
+  m_did_semi_consistent_read = false;
+}
+
+bool ha_sdb::was_semi_consistent_read() {
+  return m_did_semi_consistent_read;
+}
+
+/*
+  Read the current row again with lock, which may have been changed since
+  the semi-consistent read.
+
+  @return HA_ERR_KEY_NOT_FOUND if the row has been removed
+*/
+int ha_sdb::lock_cur_row(bson::BSONObj &obj, uchar *buf) {
+  int rc = 0;
+  bson::BSONElement be_oid;
+  bson::OID oid;
+  bson::BSONObj cond;
+
+  if (!cur_rec.getObjectID(be_oid) || bson::jstOID != be_oid.type()) {
+    rc = HA_ERR_INTERNAL_ERROR;
+    goto error;
+  }
+  oid = be_oid.__oid();
+  cond = BSON(SDB_OID_FIELD << oid);
+
+  rc = ensure_transaction();
+  if (rc != 0) {
+    goto error;
+  }
+
+  rc = collection->query_one(obj, cond, SDB_EMPTY_BSON, SDB_EMPTY_BSON,
+                             BSON("" << SDB_OID_INDEX), 0,
+                             QUERY_WITH_RETURNDATA | QUERY_FOR_UPDATE);
+  if (rc != 0) {
+    if (SDB_DMS_EOC == get_sdb_code(rc)) {
+      rc = HA_ERR_KEY_NOT_FOUND;
+    }
+    goto error;
+  }
+
+  rc = obj_to_row(obj, buf);
+  if (rc != 0) {
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  goto done;
 }
 
 int ha_sdb::get_query_flag(const uint sql_command,
                            enum thr_lock_type lock_type) {
   /*
     We always add flag QUERY_WITH_RETURNDATA to improve performance,
-    and we need to add the lock related flag QUERY_FOR_UPDATE in the following
-    cases:
-    1. SELECT ... FOR UPDATE
-    2. doing query in UPDATE ... or DELETE ...
-    3. SELECT ... LOCK IN SHARE MODE
+    and we need to add the lock related flag in the following cases:
+    1. SELECT ... FOR UPDATE, QUERY_FOR_UPDATE
+    2. doing query in UPDATE ... or DELETE ..., QUERY_FOR_UPDATE, except the
+       semi-consistent read, which locks only the matched rows
+    3. SELECT ... LOCK IN SHARE MODE, SDB_QUERY_FOR_SHARE
   */
   int query_flag = QUERY_WITH_RETURNDATA;
-  if ((lock_type >= TL_WRITE_CONCURRENT_INSERT &&
-       (SQLCOM_UPDATE == sql_command || SQLCOM_DELETE == sql_command ||
-        SQLCOM_SELECT == sql_command)) ||
-      TL_READ_WITH_SHARED_LOCKS == lock_type) {
+  if (TL_READ_WITH_SHARED_LOCKS == lock_type) {
+    query_flag |= SDB_QUERY_FOR_SHARE;
+  } else if (lock_type >= TL_WRITE_CONCURRENT_INSERT &&
+             (SQLCOM_UPDATE == sql_command || SQLCOM_DELETE == sql_command ||
+              SQLCOM_SELECT == sql_command) &&
+             !m_semi_consistent_read) {
     query_flag |= QUERY_FOR_UPDATE;
   }
   return query_flag;
@@ -2186,6 +4136,7 @@ const Item *ha_sdb::cond_push(const Item *cond) {
     goto done;
   }
 
+  sdb_condition.use_lob = m_use_lob;
   try {
     sdb_parse_condtion(cond, &sdb_condition);
     sdb_condition.to_bson(pushed_condition);
@@ -2197,7 +4148,7 @@ const Item *ha_sdb::cond_push(const Item *cond) {
 
   if (SDB_COND_SUPPORTED == sdb_condition.status) {
     // TODO: build unanalysable condition
-    remain_cond = NULL;
+    remain_cond = sdb_condition.need_recheck ? cond : NULL;
   } else {
     if (NULL != ha_thd()) {
       SDB_LOG_DEBUG(
@@ -2245,6 +4196,67 @@ static void init_sdb_psi_keys(void) {
 }
 #endif
 
+/*
+  Prepare of two-phase commit, so that SequoiaDB joins the binlog group
+  commit as a transactional participant. It is NOT crash safe: SequoiaDB
+  keeps no prepared state, so a crash between the binlog write and the
+  commit leaves the transaction in the binlog but rolled back in SequoiaDB.
+  Prepare only asks the server whether the transaction is still alive, so
+  that a transaction already lost is rolled back before it is binlogged.
+  XA PREPARE of the user is refused, as it promises a state which survives
+  a crash.
+*/
+static int sdb_prepare(handlerton *hton, THD *thd, bool all) {
+  int rc = 0;
+  Sdb_conn *connection = NULL;
+
+  if (!all && thd_test_options(thd, OPTION_NOT_AUTOCOMMIT | OPTION_BEGIN)) {
+    // end of statement in a transaction, the transaction is prepared later
+    goto done;
+  }
+
+  if (!thd->get_transaction()->xid_state()->has_state(XID_STATE::XA_NOTR)) {
+    rc = HA_ERR_UNSUPPORTED;
+    goto error;
+  }
+
+  connection = check_sdb_in_thd(thd);
+  if (NULL == connection) {
+    rc = HA_ERR_NO_CONNECTION;
+    goto error;
+  }
+  DBUG_ASSERT(connection->thread_id() == thd->thread_id());
+
+  if (connection->is_transaction_on()) {
+    rc = connection->check_transaction();
+    if (rc != 0) {
+      goto error;
+    }
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+/*
+  Nothing is recovered. No transaction is left prepared in SequoiaDB after
+  a crash, it has been rolled back when the connection was lost, even if
+  it is in the binlog.
+*/
+static int sdb_recover(handlerton *hton, XID *xid_list, uint len) {
+  return 0;
+}
+
+static int sdb_commit_by_xid(handlerton *hton, XID *xid) {
+  return XAER_NOTA;
+}
+
+static int sdb_rollback_by_xid(handlerton *hton, XID *xid) {
+  return XAER_NOTA;
+}
+
 // Commit a transaction started in SequoiaDB.
 static int sdb_commit(handlerton *hton, THD *thd, bool all) {
   int rc = 0;
@@ -2276,6 +4288,7 @@ static int sdb_commit(handlerton *hton, THD *thd, bool all) {
       SequoiaDB.
     */
     thd_sdb->save_point_count++;
+    connection->release_stmt_savepoint();
     goto done;
   }
   thd_sdb->save_point_count = 0;
@@ -2310,13 +4323,16 @@ static int sdb_rollback(handlerton *hton, THD *thd, bool all) {
     goto done;
   }
 
-  if (!all && thd_test_options(thd, OPTION_NOT_AUTOCOMMIT | OPTION_BEGIN) &&
-      (thd_sdb->save_point_count > 0)) {
+  if (!all && thd_test_options(thd, OPTION_NOT_AUTOCOMMIT | OPTION_BEGIN)) {
+    // The statement is undone by the undo log if possible.
+    if (0 == connection->rollback_stmt()) {
+      goto done;
+    }
     /*
-      Ignore end-of-statement until real rollback or commit is called
-      as SequoiaDB does not support rollback statement
+      Otherwise SequoiaDB can't roll back the statement alone
       - mark that rollback was unsuccessful, this will cause full rollback
-      of the transaction
+      of the transaction, so that the session doesn't go on as if only the
+      statement failed
     */
     thd_mark_transaction_to_rollback(thd, 1);
     my_error(ER_WARN_ENGINE_TRANSACTION_ROLLBACK, MYF(0), "SequoiaDB");
@@ -2335,6 +4351,42 @@ error:
   goto done;
 }
 
+static int sdb_savepoint_set(handlerton *hton, THD *thd, void *sv) {
+  Sdb_conn *connection = check_sdb_in_thd(thd, true);
+  if (NULL == connection) {
+    return HA_ERR_NO_CONNECTION;
+  }
+  connection->set_savepoint(*(Sdb_savepoint *)sv);
+  return 0;
+}
+
+static int sdb_savepoint_rollback(handlerton *hton, THD *thd, void *sv) {
+  int rc = 0;
+  Sdb_conn *connection = check_sdb_in_thd(thd, true);
+  if (NULL == connection) {
+    rc = HA_ERR_NO_CONNECTION;
+    goto error;
+  }
+
+  rc = connection->rollback_to_savepoint(*(Sdb_savepoint *)sv);
+  if (rc != 0) {
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  // The changes may be partly undone, only a full rollback is safe now.
+  if (HA_ERR_NO_SAVEPOINT != rc) {
+    thd_mark_transaction_to_rollback(thd, 1);
+  }
+  goto done;
+}
+
+static int sdb_savepoint_release(handlerton *hton, THD *thd, void *sv) {
+  return 0;
+}
+
 static void sdb_drop_database(handlerton *hton, char *path) {
   int rc = 0;
   char db_name[SDB_CS_NAME_MAX_SIZE + 1] = {0};
@@ -2389,9 +4441,19 @@ static int sdb_init_func(void *p) {
   sdb_hton->state = SHOW_OPTION_YES;
   sdb_hton->db_type = DB_TYPE_UNKNOWN;
   sdb_hton->create = sdb_create_handler;
-  sdb_hton->flags = (HTON_SUPPORT_LOG_TABLES | HTON_NO_PARTITION);
+  // Tables are partitioned by the generic partition handler, with each
+  // partition in its own collection.
+  sdb_hton->flags = HTON_SUPPORT_LOG_TABLES;
   sdb_hton->commit = sdb_commit;
   sdb_hton->rollback = sdb_rollback;
+  sdb_hton->prepare = sdb_prepare;
+  sdb_hton->recover = sdb_recover;
+  sdb_hton->commit_by_xid = sdb_commit_by_xid;
+  sdb_hton->rollback_by_xid = sdb_rollback_by_xid;
+  sdb_hton->savepoint_offset = sizeof(Sdb_savepoint);
+  sdb_hton->savepoint_set = sdb_savepoint_set;
+  sdb_hton->savepoint_rollback = sdb_savepoint_rollback;
+  sdb_hton->savepoint_release = sdb_savepoint_release;
   sdb_hton->drop_database = sdb_drop_database;
   sdb_hton->close_connection = sdb_close_connection;
   if (conn_addrs.parse_conn_addrs(sdb_conn_str)) {
@@ -2419,6 +4481,34 @@ static int sdb_done_func(void *p) {
 static struct st_mysql_storage_engine sdb_storage_engine = {
     MYSQL_HANDLERTON_INTERFACE_VERSION};
 
+static int sdb_show_bulk_insert_target_bytes(THD *thd, SHOW_VAR *var,
+                                             char *buff) {
+  Thd_sdb *thd_sdb = thd_get_thd_sdb(thd);
+  ulonglong max_bytes = sdb_bulk_insert_max_bytes;
+  var->type = SHOW_LONGLONG;
+  var->value = buff;
+  *((ulonglong *)buff) =
+      thd_sdb ? thd_sdb->bulk_insert_ctrl.target_bytes(max_bytes) : 0;
+  return 0;
+}
+
+static int sdb_show_bulk_insert_peak_bytes(THD *thd, SHOW_VAR *var,
+                                           char *buff) {
+  Thd_sdb *thd_sdb = thd_get_thd_sdb(thd);
+  var->type = SHOW_LONGLONG;
+  var->value = buff;
+  *((ulonglong *)buff) = thd_sdb ? thd_sdb->bulk_insert_ctrl.peak_bytes() : 0;
+  return 0;
+}
+
+static struct st_mysql_show_var sdb_status_vars[] = {
+    {"Sequoiadb_bulk_insert_target_bytes",
+     (char *)&sdb_show_bulk_insert_target_bytes, SHOW_FUNC,
+     SHOW_SCOPE_SESSION},
+    {"Sequoiadb_bulk_insert_peak_bytes",
+     (char *)&sdb_show_bulk_insert_peak_bytes, SHOW_FUNC, SHOW_SCOPE_SESSION},
+    {NullS, NullS, SHOW_LONG, SHOW_SCOPE_GLOBAL}};
+
 mysql_declare_plugin(sequoiadb){
     MYSQL_STORAGE_ENGINE_PLUGIN,
     &sdb_storage_engine,
@@ -2426,11 +4516,11 @@ mysql_declare_plugin(sequoiadb){
     "SequoiaDB Inc.",
     sdb_plugin_info,
     PLUGIN_LICENSE_GPL,
-    sdb_init_func, /* Plugin Init */
-    sdb_done_func, /* Plugin Deinit */
-    0x0302,        /* version */
-    NULL,          /* status variables */
-    sdb_sys_vars,  /* system variables */
-    NULL,          /* config options */
-    0,             /* flags */
+    sdb_init_func,   /* Plugin Init */
+    sdb_done_func,   /* Plugin Deinit */
+    0x0302,          /* version */
+    sdb_status_vars, /* status variables */
+    sdb_sys_vars,    /* system variables */
+    NULL,            /* config options */
+    0,               /* flags */
 } mysql_declare_plugin_end;
@@ -17,10 +17,21 @@
 #include <mysql_version.h>
 #include <client.hpp>
 #include <vector>
+#include <set>
+#include <string>
 #include "sdb_def.h"
 #include "sdb_cl.h"
 #include "sdb_util.h"
 #include "sdb_lock.h"
+#include "sdb_codec.h"
+
+class Sdb_batch_ctrl;
+
+/*
+  Rows whose BLOB data are referred by the record rather than copied, are kept
+  alive until this number of rows more are read.
+*/
+#define SDB_PINNED_ROW_COUNT 8
 
 /*
   Stats that can be retrieved from SequoiaDB.
@@ -48,6 +59,11 @@ struct Sdb_share {
   THR_LOCK lock;
   Sdb_mutex mutex;
   Sdb_statistics stat;
+  // AUTO_INCREMENT values [auto_inc_next, auto_inc_end) reserved by this SQL
+  // node, which are handed out without lock, see ha_sdb::claim_auto_inc().
+  volatile int64 auto_inc_next;
+  volatile int64 auto_inc_end;
+  bson::BSONObj *sharding_key;  // ShardingKey of collection, NULL if unloaded
 };
 
 class ha_sdb : public handler {
@@ -194,6 +210,62 @@ class ha_sdb : public handler {
   */
   int delete_row(const uchar *buf);
 
+  /** @brief
+    Prepares the storage engine for bulk updates. Rows updated by the same
+    rule are buffered and updated by _id in batches.
+
+    @return false if bulk update is used
+  */
+  bool start_bulk_update();
+
+  /** @brief
+    Update a row in bulk update mode. The row may be buffered, the buffered
+    rows are sent when the rule changes or the batch is full.
+  */
+  int bulk_update_row(const uchar *old_data, uchar *new_data,
+                      uint *dup_key_found);
+
+  /** @brief
+    Send the buffered rows of bulk update to the remote server.
+  */
+  int exec_bulk_update(uint *dup_key_found);
+
+  /** @brief
+    End bulk update.
+  */
+  void end_bulk_update();
+
+  /** @brief
+    Prepares the storage engine for bulk deletes. The deleted rows are
+    buffered and removed by _id in batches.
+
+    @return false if bulk delete is used
+  */
+  bool start_bulk_delete();
+
+  /** @brief
+    End bulk delete, the remaining rows are removed from the remote server.
+
+    @return Operation status
+  */
+  int end_bulk_delete();
+
+  /** @brief
+    Read before write removal. The SQL layer calls it when an UPDATE or DELETE
+    is qualified by all parts of a unique key and reads no other columns, so
+    that the row needn't be fetched before it is written.
+
+    @return true if read before write removal is used by this statement
+  */
+  bool start_read_removal(void);
+
+  /** @brief
+    End read before write removal.
+
+    @return number of rows actually written during read removal
+  */
+  ha_rows end_read_removal(void);
+
   /** @brief
     We implement this in ha_example.cc. It's not an obligatory method;
     skip it and and MySQL will treat it as not implemented.
@@ -248,6 +320,9 @@ class ha_sdb : public handler {
   int rnd_pos(uchar *buf, uchar *pos);
   void position(const uchar *record);
   int info(uint);
+  void get_auto_increment(ulonglong offset, ulonglong increment,
+                          ulonglong nb_desired_values, ulonglong *first_value,
+                          ulonglong *nb_reserved_values);
   int extra(enum ha_extra_function operation);
   int external_lock(THD *thd, int lock_type);
   int start_statement(THD *thd, uint table_count);
@@ -264,6 +339,10 @@ class ha_sdb : public handler {
 
   void unlock_row();
 
+  void try_semi_consistent_read(bool yes);
+
+  bool was_semi_consistent_read();
+
   int start_stmt(THD *thd, thr_lock_type lock_type);
 
   bool prepare_inplace_alter_table(TABLE *altered_table,
@@ -282,24 +361,79 @@ class ha_sdb : public handler {
  private:
   int ensure_collection(THD *thd);
 
+  int ensure_transaction();
+
+  Sdb_conn *undo_log();
+
   int obj_to_row(bson::BSONObj &obj, uchar *buf);
 
+  void release_pinned_rows();
+
   int bson_element_to_field(const bson::BSONElement elem, Field *field);
 
+  int keep_blob_value(Field *field, MEM_ROOT *root = NULL);
+
   int row_to_obj(uchar *buf, bson::BSONObj &obj, bool gen_oid, bool output_null,
                  bson::BSONObj &null_obj);
 
   int field_to_obj(Field *field, bson::BSONObjBuilder &obj_builder);
 
+  bool is_lob_field(Field *field);
+
+  int append_lob(Field *field, const String &str,
+                 bson::BSONObjBuilder &obj_builder);
+
+  int read_lob(const bson::BSONElement &elem, Field *field);
+
+  void remove_row_lobs(const bson::BSONObj &rule);
+
+  void remove_created_lobs(std::vector<bson::OID> &lobs);
+
+  int encode_row(uchar *buf, Sdb_bson_arena &arena, bson::BSONObj &obj);
+
   int get_update_obj(const uchar *old_data, uchar *new_data, bson::BSONObj &obj,
                      bson::BSONObj &null_obj);
 
+  int get_update_rule(const uchar *old_data, uchar *new_data,
+                      bson::BSONObj &rule);
+
   int next_row(bson::BSONObj &obj, uchar *buf);
 
+  int lock_cur_row(bson::BSONObj &obj, uchar *buf);
+
   int cur_row(uchar *buf);
 
+  void finish_async_insert_lobs(int rc);
+
   int flush_bulk_insert(bool ignore_dup_key);
 
+  ulonglong bulk_insert_max_bytes();
+
+  ulonglong bulk_insert_target_bytes();
+
+  int remove_replaced_rows();
+
+  bool is_pending_replace(const bson::BSONObj &key_cond);
+
+  int upsert_row(uchar *buf, const bson::BSONObj &key_cond);
+
+  bool init_upsert_key();
+
+  bool init_upsert_fields();
+
+  my_bool get_upsert_cond(uchar *buf, bson::BSONObj &cond);
+
+  bool is_single_row_insert();
+
+  bool is_single_row_removal();
+
+  int flush_bulk_delete();
+
+  int flush_bulk_update();
+
+  void locate_bulk_update_dup(const bson::BSONObj &rule,
+                              const bson::BSONObj &cond);
+
   int create_index(Sdb_cl &cl, Alter_inplace_info *ha_alter_info,
                    Bitmap<MAX_INDEXES> &ignored_keys);
 
@@ -309,18 +443,38 @@ class ha_sdb : public handler {
   int get_cl_options(TABLE *form, HA_CREATE_INFO *create_info,
                      bson::BSONObj &options, my_bool use_partition);
 
-  int get_sharding_key(TABLE *form, bson::BSONObj &options);
+  int get_sharding_key(TABLE *form, const bson::BSONObj &specified_key,
+                       bson::BSONObj &sharding_key);
 
   int index_read_one(bson::BSONObj condition, int order_direction, uchar *buf);
 
+  bool can_remove_read(const uchar *key_ptr, key_part_map keypart_map);
+
   my_bool get_unique_key_cond(const uchar *rec_row, bson::BSONObj &cond);
 
+  void get_write_cond(const uchar *rec_row, bson::BSONObj &cond);
+
+  void load_sharding_key(Sdb_conn *conn);
+
   my_bool get_cond_from_key(const KEY *unique_key, bson::BSONObj &cond);
 
+  my_bool get_read_removal_cond(const uchar *rec_row, bson::BSONObj &cond);
+
   int get_query_flag(const uint sql_command, enum thr_lock_type lock_type);
 
   int update_stats(THD *thd, bool do_read_stat);
 
+  bool claim_auto_inc(ulonglong offset, ulonglong increment, ulonglong count,
+                      ulonglong &first);
+
+  int reserve_auto_inc(ulonglong span);
+
+  int raise_auto_inc(ulonglong value);
+
+  int raise_auto_inc_by_row(const uchar *row);
+
+  int init_auto_inc_seq();
+
  private:
   THR_LOCK_DATA lock_data;
   enum thr_lock_type m_lock_type;
@@ -336,6 +490,42 @@ class ha_sdb : public handler {
   MEM_ROOT blobroot;
   int idx_order_direction;
   bool m_use_bulk_insert;
+  bool m_use_async_bulk_insert;
+  ulonglong m_bulk_insert_bytes;   // bytes of m_bulk_insert_rows
+  ulonglong m_async_insert_bytes;  // bytes of the batch in flight
+  Sdb_batch_ctrl *m_bulk_insert_ctrl;
+  Sdb_row_encoder m_row_encoder;
+  Sdb_row_decoder m_row_decoder;
+  bool m_datetime_as_int64;  // DATETIME is stored as packed int64
+  String m_conv_str;         // buffer of charset conversion
+  ulonglong m_lob_threshold;  // BLOB/TEXT of at least the size is in LOB
+  bool m_use_lob;             // some fields may be stored in LOBs
+  bson::BSONObj m_sharding_key;  // copy of share->sharding_key
+  std::vector<bson::OID> m_created_lobs;  // LOBs of the row being written
+  std::vector<bson::OID> m_bulk_insert_lobs[2];  // LOBs of m_insert_arena
+  MEM_ROOT m_lob_root;  // values fetched from LOBs of current row
+  bson::BSONObj m_pinned_rows[SDB_PINNED_ROW_COUNT];
+  uint m_pinned_row_idx;
+  // rows of bulk insert, one more for the batch in flight in async mode
+  Sdb_bson_arena m_insert_arena[2];
+  uint m_insert_arena_idx;
   std::vector<bson::BSONObj> m_bulk_insert_rows;
   Sdb_obj_cache<bson::BSONElement> m_bson_element_cache;
+  bool m_use_bulk_delete;
+  std::vector<bson::OID> m_bulk_delete_oids;
+  bool m_use_bulk_update;
+  std::vector<bson::OID> m_bulk_update_oids;
+  bson::BSONObj m_bulk_update_rule;
+  uint m_dup_key_nr;  // the key of last duplicate key error, if known
+  bool m_write_can_replace;            // REPLACE resolved by upsert
+  bool m_insert_with_update;           // ON DUPLICATE KEY UPDATE by upsert
+  uint m_upsert_key;                   // the only unique key of table
+  Bitmap<MAX_FIELDS> m_upsert_fields;  // fields of ON DUPLICATE KEY UPDATE
+  std::vector<bson::BSONObj> m_bulk_replace_conds;
+  std::set<std::string> m_bulk_replace_keys;  // bytes of m_bulk_replace_conds
+  bool m_use_read_removal;
+  bool m_read_removal_row;  // current row is built from key, not fetched
+  ha_rows m_read_removal_rows;
+  bool m_semi_consistent_read;
+  bool m_did_semi_consistent_read;  // current row is read without lock
 };
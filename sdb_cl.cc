@@ -14,13 +14,20 @@
   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
 
 #include <my_base.h>
+#include <my_sys.h>
 #include "sdb_cl.h"
 #include "sdb_conn.h"
 #include "sdb_errcode.h"
 
 using namespace sdbclient;
 
-Sdb_cl::Sdb_cl() : m_conn(NULL), m_thread_id(0) {}
+Sdb_cl::Sdb_cl()
+    : m_conn(NULL),
+      m_thread_id(0),
+      m_async_running(false),
+      m_async_rc(SDB_ERR_OK),
+      m_async_flag(0),
+      m_async_usecs(0) {}
 
 Sdb_cl::~Sdb_cl() {
   close();
@@ -38,6 +45,7 @@ int Sdb_cl::init(Sdb_conn *connection, char *cs_name, char *cl_name) {
 
   m_conn = connection;
   m_thread_id = connection->thread_id();
+  m_conn->wait_async();
 
 retry:
   rc = m_conn->get_sdb().getCollectionSpace(cs_name, cs);
@@ -80,6 +88,8 @@ int Sdb_cl::query(const bson::BSONObj &condition, const bson::BSONObj &selected,
                   INT64 numToSkip, INT64 numToReturn, INT32 flags) {
   int rc = SDB_ERR_OK;
   int retry_times = 2;
+
+  m_conn->wait_async();
 retry:
   rc = m_cl.query(m_cursor, condition, selected, orderBy, hint, numToSkip,
                   numToReturn, flags);
@@ -107,6 +117,8 @@ int Sdb_cl::query_one(bson::BSONObj &obj, const bson::BSONObj &condition,
   int rc = SDB_ERR_OK;
   sdbclient::sdbCursor cursor_tmp;
   int retry_times = 2;
+
+  m_conn->wait_async();
 retry:
   rc = m_cl.query(cursor_tmp, condition, selected, orderBy, hint, numToSkip, 1,
                   flags);
@@ -134,6 +146,8 @@ error:
 
 int Sdb_cl::current(bson::BSONObj &obj) {
   int rc = SDB_ERR_OK;
+
+  m_conn->wait_async();
   rc = m_cursor.current(obj);
   if (rc != SDB_ERR_OK) {
     if (SDB_DMS_EOC == rc) {
@@ -151,6 +165,8 @@ error:
 
 int Sdb_cl::next(bson::BSONObj &obj) {
   int rc = SDB_ERR_OK;
+
+  m_conn->wait_async();
   rc = m_cursor.next(obj);
   if (rc != SDB_ERR_OK) {
     if (SDB_DMS_EOC == rc) {
@@ -169,6 +185,8 @@ error:
 int Sdb_cl::insert(bson::BSONObj &obj) {
   int rc = SDB_ERR_OK;
   int retry_times = 2;
+
+  m_conn->wait_async();
 retry:
   rc = m_cl.insert(obj);
   if (rc != SDB_ERR_OK) {
@@ -190,6 +208,7 @@ error:
 int Sdb_cl::bulk_insert(INT32 flag, std::vector<bson::BSONObj> &objs) {
   int rc = SDB_ERR_OK;
 
+  m_conn->wait_async();
   rc = m_cl.bulkInsert(flag, objs);
   if (rc != SDB_ERR_OK) {
     goto error;
@@ -202,11 +221,68 @@ error:
   goto done;
 }
 
+void Sdb_cl::run_async() {
+  ulonglong begin = my_micro_time();
+  m_async_rc = m_cl.bulkInsert(m_async_flag, m_async_objs);
+  m_async_usecs = my_micro_time() - begin;
+  convert_sdb_code(m_async_rc);
+}
+
+int Sdb_cl::bulk_insert_async(INT32 flag, std::vector<bson::BSONObj> &objs) {
+  int rc = SDB_ERR_OK;
+
+  // The result of last batch is returned first.
+  rc = wait_async();
+  if (rc != SDB_ERR_OK) {
+    goto error;
+  }
+  m_conn->wait_async();
+
+  m_async_objs.swap(objs);
+  objs.clear();
+  m_async_flag = flag;
+  m_async_rc = SDB_ERR_OK;
+
+  if (m_conn->start_async(this)) {
+    // Fall back to send it synchronously.
+    run_async();
+    rc = m_async_rc;
+    m_async_rc = SDB_ERR_OK;
+    m_async_objs.clear();
+  } else {
+    m_async_running = true;
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+int Sdb_cl::wait_async() {
+  int rc = SDB_ERR_OK;
+
+  join_async();
+  rc = m_async_rc;
+  m_async_rc = SDB_ERR_OK;
+  return rc;
+}
+
+void Sdb_cl::join_async() {
+  if (m_async_running) {
+    m_conn->join_async();
+    m_async_running = false;
+    m_async_objs.clear();
+  }
+}
+
 int Sdb_cl::upsert(const bson::BSONObj &rule, const bson::BSONObj &condition,
                    const bson::BSONObj &hint, const bson::BSONObj &setOnInsert,
                    INT32 flag) {
   int rc = SDB_ERR_OK;
   int retry_times = 2;
+
+  m_conn->wait_async();
 retry:
   rc = m_cl.upsert(rule, condition, hint, setOnInsert, flag);
   if (rc != SDB_ERR_OK) {
@@ -229,6 +305,8 @@ int Sdb_cl::update(const bson::BSONObj &rule, const bson::BSONObj &condition,
                    const bson::BSONObj &hint, INT32 flag) {
   int rc = SDB_ERR_OK;
   int retry_times = 2;
+
+  m_conn->wait_async();
 retry:
   rc = m_cl.update(rule, condition, hint, flag);
   if (rc != SDB_ERR_OK) {
@@ -250,6 +328,8 @@ error:
 int Sdb_cl::del(const bson::BSONObj &condition, const bson::BSONObj &hint) {
   int rc = SDB_ERR_OK;
   int retry_times = 2;
+
+  m_conn->wait_async();
 retry:
   rc = m_cl.del(condition, hint);
   if (rc != SDB_ERR_OK) {
@@ -268,10 +348,105 @@ error:
   goto done;
 }
 
+/*
+  Update the first record matched by condition, the record is returned in the
+  reply of the request, so we know whether it exists without another round
+  trip.
+
+  @return HA_ERR_END_OF_FILE if no record is matched
+*/
+int Sdb_cl::query_and_update_one(const bson::BSONObj &rule,
+                                 const bson::BSONObj &condition,
+                                 const bson::BSONObj &hint, INT32 flags,
+                                 bson::BSONObj *old_obj) {
+  int rc = SDB_ERR_OK;
+  sdbclient::sdbCursor cursor_tmp;
+  bson::BSONObj obj;
+  int retry_times = 2;
+
+  m_conn->wait_async();
+retry:
+  rc = m_cl.queryAndUpdate(cursor_tmp, rule, condition, SDB_EMPTY_BSON,
+                           SDB_EMPTY_BSON, hint, 0, 1, flags);
+  if (rc != SDB_ERR_OK) {
+    goto error;
+  }
+
+  rc = cursor_tmp.next(obj);
+  if (rc != SDB_ERR_OK) {
+    if (SDB_DMS_EOC == rc) {
+      rc = HA_ERR_END_OF_FILE;
+      goto done;
+    }
+    goto error;
+  }
+  if (old_obj) {
+    *old_obj = obj.getOwned();
+  }
+
+done:
+  return rc;
+error:
+  if (IS_SDB_NET_ERR(rc)) {
+    bool is_transaction = m_conn->is_transaction_on();
+    if (0 == m_conn->connect() && !is_transaction && retry_times-- > 0) {
+      goto retry;
+    }
+  }
+  convert_sdb_code(rc);
+  goto done;
+}
+
+/*
+  @return HA_ERR_END_OF_FILE if no record is matched
+*/
+int Sdb_cl::query_and_remove_one(const bson::BSONObj &condition,
+                                 const bson::BSONObj &hint, INT32 flags,
+                                 bson::BSONObj *old_obj) {
+  int rc = SDB_ERR_OK;
+  sdbclient::sdbCursor cursor_tmp;
+  bson::BSONObj obj;
+  int retry_times = 2;
+
+  m_conn->wait_async();
+retry:
+  rc = m_cl.queryAndRemove(cursor_tmp, condition, SDB_EMPTY_BSON,
+                           SDB_EMPTY_BSON, hint, 0, 1, flags);
+  if (rc != SDB_ERR_OK) {
+    goto error;
+  }
+
+  rc = cursor_tmp.next(obj);
+  if (rc != SDB_ERR_OK) {
+    if (SDB_DMS_EOC == rc) {
+      rc = HA_ERR_END_OF_FILE;
+      goto done;
+    }
+    goto error;
+  }
+  if (old_obj) {
+    *old_obj = obj.getOwned();
+  }
+
+done:
+  return rc;
+error:
+  if (IS_SDB_NET_ERR(rc)) {
+    bool is_transaction = m_conn->is_transaction_on();
+    if (0 == m_conn->connect() && !is_transaction && retry_times-- > 0) {
+      goto retry;
+    }
+  }
+  convert_sdb_code(rc);
+  goto done;
+}
+
 int Sdb_cl::create_index(const bson::BSONObj &indexDef, const CHAR *pName,
                          BOOLEAN isUnique, BOOLEAN isEnforced) {
   int rc = SDB_ERR_OK;
   int retry_times = 2;
+
+  m_conn->wait_async();
 retry:
   rc = m_cl.createIndex(indexDef, pName, isUnique, isEnforced);
   if (SDB_IXM_REDEF == rc) {
@@ -296,6 +471,8 @@ error:
 int Sdb_cl::drop_index(const char *pName) {
   int rc = SDB_ERR_OK;
   int retry_times = 2;
+
+  m_conn->wait_async();
 retry:
   rc = m_cl.dropIndex(pName);
   if (SDB_IXM_NOTEXIST == rc) {
@@ -320,6 +497,8 @@ error:
 int Sdb_cl::truncate() {
   int rc = SDB_ERR_OK;
   int retry_times = 2;
+
+  m_conn->wait_async();
 retry:
   rc = m_cl.truncate();
   if (rc != SDB_ERR_OK) {
@@ -339,6 +518,9 @@ error:
 }
 
 void Sdb_cl::close() {
+  if (NULL != m_conn) {
+    m_conn->wait_async();
+  }
   m_cursor.close();
 }
 
@@ -349,6 +531,8 @@ my_thread_id Sdb_cl::thread_id() {
 int Sdb_cl::drop() {
   int rc = SDB_ERR_OK;
   int retry_times = 2;
+
+  m_conn->wait_async();
 retry:
   rc = m_cl.drop();
   if (rc != SDB_ERR_OK) {
@@ -376,6 +560,8 @@ int Sdb_cl::get_count(long long &count,
                       const bson::BSONObj &hint) {
   int rc = SDB_ERR_OK;
   int retry_times = 2;
+
+  m_conn->wait_async();
 retry:
   rc = m_cl.getCount(count, condition, hint);
   if (rc != SDB_ERR_OK) {
@@ -393,3 +579,124 @@ error:
   convert_sdb_code(rc);
   goto done;
 }
+
+int Sdb_cl::create_lob(const char *data, size_t size, bson::OID &oid) {
+  int rc = SDB_ERR_OK;
+  sdbLob lob;
+  size_t written = 0;
+
+  m_conn->wait_async();
+  rc = m_cl.createLob(lob);
+  if (rc != SDB_ERR_OK) {
+    goto error;
+  }
+
+  while (written < size) {
+    UINT32 len = (UINT32)MY_MIN(size - written, SDB_LOB_CHUNK_SIZE);
+    rc = lob.write(data + written, len);
+    if (rc != SDB_ERR_OK) {
+      goto error;
+    }
+    written += len;
+  }
+
+  rc = lob.getOid(oid);
+  if (rc != SDB_ERR_OK) {
+    goto error;
+  }
+  rc = lob.close();
+  if (rc != SDB_ERR_OK) {
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  if (IS_SDB_NET_ERR(rc)) {
+    m_conn->connect();
+  }
+  convert_sdb_code(rc);
+  goto done;
+}
+
+int Sdb_cl::read_lob(const bson::OID &oid, MEM_ROOT *root, char *&data,
+                     size_t &size) {
+  int rc = SDB_ERR_OK;
+  sdbLob lob;
+  SINT64 lob_size = 0;
+  size_t read_size = 0;
+
+  data = NULL;
+  size = 0;
+
+  m_conn->wait_async();
+  rc = m_cl.openLob(lob, oid);
+  if (rc != SDB_ERR_OK) {
+    goto error;
+  }
+
+  rc = lob.getSize(&lob_size);
+  if (rc != SDB_ERR_OK) {
+    goto error;
+  }
+
+  data = (char *)alloc_root(root, (size_t)lob_size + 1);
+  if (NULL == data) {
+    rc = HA_ERR_OUT_OF_MEM;
+    goto done;
+  }
+
+  while (read_size < (size_t)lob_size) {
+    UINT32 len = 0;
+    rc = lob.read((UINT32)MY_MIN((size_t)lob_size - read_size,
+                                 SDB_LOB_CHUNK_SIZE),
+                  data + read_size, &len);
+    if (rc != SDB_ERR_OK) {
+      goto error;
+    }
+    read_size += len;
+  }
+  size = read_size;
+
+  rc = lob.close();
+  if (rc != SDB_ERR_OK) {
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  if (IS_SDB_NET_ERR(rc)) {
+    m_conn->connect();
+  }
+  convert_sdb_code(rc);
+  goto done;
+}
+
+int Sdb_cl::remove_lob(const bson::OID &oid) {
+  int rc = SDB_ERR_OK;
+  int retry_times = 2;
+
+  m_conn->wait_async();
+retry:
+  rc = m_cl.removeLob(oid);
+  if (rc != SDB_ERR_OK) {
+    if (SDB_FNE == rc) {
+      // removed already
+      rc = SDB_ERR_OK;
+      goto done;
+    }
+    goto error;
+  }
+done:
+  return rc;
+error:
+  if (IS_SDB_NET_ERR(rc)) {
+    bool is_transaction = m_conn->is_transaction_on();
+    if (0 == m_conn->connect() && !is_transaction && retry_times-- > 0) {
+      goto retry;
+    }
+  }
+  convert_sdb_code(rc);
+  goto done;
+}
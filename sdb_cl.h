@@ -17,6 +17,7 @@
 #define SDB_CL__H
 
 #include <mysql/psi/mysql_thread.h>
+#include <my_sys.h>
 #include <vector>
 #include <client.hpp>
 #include "sdb_def.h"
@@ -57,6 +58,21 @@ class Sdb_cl {
 
   int bulk_insert(INT32 flag, std::vector<bson::BSONObj> &objs);
 
+  /*
+    Send the records in background, objs is taken over and left empty. The
+    error of the request is returned by the next call or by wait_async().
+  */
+  int bulk_insert_async(INT32 flag, std::vector<bson::BSONObj> &objs);
+
+  // Wait for the background request, and return its result.
+  int wait_async();
+
+  // Wait for the background request, and keep its result.
+  void join_async();
+
+  // Microseconds taken by the last background request.
+  inline ulonglong async_usecs() { return m_async_usecs; }
+
   int update(const bson::BSONObj &rule,
              const bson::BSONObj &condition = SDB_EMPTY_BSON,
              const bson::BSONObj &hint = SDB_EMPTY_BSON, INT32 flag = 0);
@@ -69,6 +85,18 @@ class Sdb_cl {
   int del(const bson::BSONObj &condition = SDB_EMPTY_BSON,
           const bson::BSONObj &hint = SDB_EMPTY_BSON);
 
+  // The record before update or removal is returned by old_obj if not NULL.
+  int query_and_update_one(const bson::BSONObj &rule,
+                           const bson::BSONObj &condition = SDB_EMPTY_BSON,
+                           const bson::BSONObj &hint = SDB_EMPTY_BSON,
+                           INT32 flags = QUERY_WITH_RETURNDATA,
+                           bson::BSONObj *old_obj = NULL);
+
+  int query_and_remove_one(const bson::BSONObj &condition = SDB_EMPTY_BSON,
+                           const bson::BSONObj &hint = SDB_EMPTY_BSON,
+                           INT32 flags = QUERY_WITH_RETURNDATA,
+                           bson::BSONObj *old_obj = NULL);
+
   int create_index(const bson::BSONObj &indexDef, const CHAR *pName,
                    BOOLEAN isUnique, BOOLEAN isEnforced);
 
@@ -86,10 +114,30 @@ class Sdb_cl {
                 const bson::BSONObj &condition = SDB_EMPTY_BSON, 
                 const bson::BSONObj &hint = SDB_EMPTY_BSON);
 
+  // Create a LOB holding the data, which is written in chunks.
+  int create_lob(const char *data, size_t size, bson::OID &oid);
+
+  // Read the whole LOB in chunks into the memory allocated from root.
+  int read_lob(const bson::OID &oid, MEM_ROOT *root, char *&data,
+               size_t &size);
+
+  int remove_lob(const bson::OID &oid);
+
+ private:
+  friend class Sdb_conn;
+
+  // Run the background request, by the worker of the connection.
+  void run_async();
+
  private:
   Sdb_conn *m_conn;
   my_thread_id m_thread_id;
   sdbclient::sdbCollection m_cl;
   sdbclient::sdbCursor m_cursor;
+  bool m_async_running;
+  int m_async_rc;
+  INT32 m_async_flag;
+  ulonglong m_async_usecs;
+  std::vector<bson::BSONObj> m_async_objs;
 };
 #endif
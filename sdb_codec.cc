@@ -0,0 +1,896 @@
+/* Copyright (c) 2018, SequoiaDB and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#ifndef MYSQL_SERVER
+#define MYSQL_SERVER
+#endif
+
+#include "sdb_codec.h"
+#include <field.h>
+#include <my_time.h>
+#include <myisampack.h>
+#include <float.h>
+#include "sdb_def.h"
+#include "sdb_errcode.h"
+#include "sdb_util.h"
+
+static const size_t SDB_ARENA_BLOCK_SIZE = 256 * 1024;
+
+Sdb_bson_arena::Sdb_bson_arena() : m_cur(0), m_used(0), m_obj_start(0) {}
+
+Sdb_bson_arena::~Sdb_bson_arena() {
+  release();
+}
+
+void Sdb_bson_arena::reset() {
+  m_cur = 0;
+  m_used = 0;
+  m_obj_start = 0;
+}
+
+void Sdb_bson_arena::release() {
+  for (std::vector<Block>::iterator it = m_blocks.begin();
+       it != m_blocks.end(); ++it) {
+    my_free(it->data);
+  }
+  m_blocks.clear();
+  reset();
+}
+
+/*
+  Move to a block which can hold the part of current object and size bytes
+  more. The former blocks are left untouched, so the objects in them keep
+  valid.
+*/
+bool Sdb_bson_arena::next_block(size_t size) {
+  size_t partial = m_blocks.empty() ? 0 : m_used - m_obj_start;
+  size_t need = partial + size;
+  uint next = m_blocks.empty() ? 0 : m_cur + 1;
+
+  if (next < m_blocks.size() && m_blocks[next].size < need) {
+    my_free(m_blocks[next].data);
+    m_blocks.erase(m_blocks.begin() + next);
+  }
+
+  if (next >= m_blocks.size()) {
+    Block block;
+    block.size = need > SDB_ARENA_BLOCK_SIZE ? need : SDB_ARENA_BLOCK_SIZE;
+    block.data = (char *)my_malloc(PSI_NOT_INSTRUMENTED, block.size, MYF(0));
+    if (NULL == block.data) {
+      return false;
+    }
+    m_blocks.insert(m_blocks.begin() + next, block);
+  }
+
+  if (partial > 0) {
+    memcpy(m_blocks[next].data, m_blocks[m_cur].data + m_obj_start, partial);
+  }
+  m_cur = next;
+  m_obj_start = 0;
+  m_used = partial;
+  return true;
+}
+
+char *Sdb_bson_arena::reserve(size_t size) {
+  char *ptr = NULL;
+  if (m_blocks.empty() || m_used + size > m_blocks[m_cur].size) {
+    if (!next_block(size)) {
+      return NULL;
+    }
+  }
+  ptr = m_blocks[m_cur].data + m_used;
+  m_used += size;
+  return ptr;
+}
+
+int Sdb_bson_arena::begin_obj() {
+  m_obj_start = m_used;
+  // the object size is filled in end_obj()
+  return reserve(4) ? SDB_ERR_OK : HA_ERR_OUT_OF_MEM;
+}
+
+int Sdb_bson_arena::end_obj(bson::BSONObj &obj) {
+  char *eoo = reserve(1);
+  if (NULL == eoo) {
+    return HA_ERR_OUT_OF_MEM;
+  }
+  *eoo = bson::EOO;
+
+  char *start = m_blocks[m_cur].data + m_obj_start;
+  int4store(start, (uint32)(m_used - m_obj_start));
+  obj = bson::BSONObj(start);
+  m_obj_start = m_used;
+  return SDB_ERR_OK;
+}
+
+char *Sdb_bson_arena::append_element(char type, const char *name,
+                                     uint name_len, size_t value_size) {
+  char *ptr = reserve(1 + name_len + 1 + value_size);
+  if (NULL == ptr) {
+    return NULL;
+  }
+  *ptr++ = type;
+  memcpy(ptr, name, name_len + 1);
+  return ptr + name_len + 1;
+}
+
+int Sdb_bson_arena::append_raw(const char *data, size_t size) {
+  char *ptr = reserve(size);
+  if (NULL == ptr) {
+    return HA_ERR_OUT_OF_MEM;
+  }
+  memcpy(ptr, data, size);
+  return SDB_ERR_OK;
+}
+
+static inline int sdb_encode_int32(Sdb_bson_arena &arena,
+                                   const Sdb_field_encoder &encoder,
+                                   int32 value) {
+  char *ptr = arena.append_element(bson::NumberInt, encoder.name,
+                                   encoder.name_len, sizeof(int32));
+  if (NULL == ptr) {
+    return HA_ERR_OUT_OF_MEM;
+  }
+  int4store(ptr, value);
+  return SDB_ERR_OK;
+}
+
+static inline int sdb_encode_int64(Sdb_bson_arena &arena,
+                                   const Sdb_field_encoder &encoder,
+                                   longlong value) {
+  char *ptr = arena.append_element(bson::NumberLong, encoder.name,
+                                   encoder.name_len, sizeof(longlong));
+  if (NULL == ptr) {
+    return HA_ERR_OUT_OF_MEM;
+  }
+  int8store(ptr, value);
+  return SDB_ERR_OK;
+}
+
+static inline int sdb_encode_double(Sdb_bson_arena &arena,
+                                    const Sdb_field_encoder &encoder,
+                                    double value) {
+  char *ptr = arena.append_element(bson::NumberDouble, encoder.name,
+                                   encoder.name_len, sizeof(double));
+  if (NULL == ptr) {
+    return HA_ERR_OUT_OF_MEM;
+  }
+  float8store(ptr, value);
+  return SDB_ERR_OK;
+}
+
+static inline int sdb_encode_bytes(Sdb_bson_arena &arena,
+                                   const Sdb_field_encoder &encoder,
+                                   const char *data, uint32 length) {
+  char *ptr = NULL;
+  if (encoder.ascii_only && !sdb_is_ascii(data, length)) {
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  if (&my_charset_bin == encoder.charset) {
+    ptr = arena.append_element(bson::BinData, encoder.name, encoder.name_len,
+                               4 + 1 + length);
+    if (NULL == ptr) {
+      return HA_ERR_OUT_OF_MEM;
+    }
+    int4store(ptr, length);
+    ptr[4] = bson::BinDataGeneral;
+    memcpy(ptr + 5, data, length);
+  } else {
+    ptr = arena.append_element(bson::String, encoder.name, encoder.name_len,
+                               4 + length + 1);
+    if (NULL == ptr) {
+      return HA_ERR_OUT_OF_MEM;
+    }
+    int4store(ptr, length + 1);
+    memcpy(ptr + 4, data, length);
+    ptr[4 + length] = '\0';
+  }
+  return SDB_ERR_OK;
+}
+
+static int sdb_encode_tiny(Sdb_bson_arena &arena,
+                           const Sdb_field_encoder &encoder, const uchar *ptr) {
+  int32 value = encoder.unsigned_flag ? (int32)ptr[0] : (int32)(int8)ptr[0];
+  return sdb_encode_int32(arena, encoder, value);
+}
+
+static int sdb_encode_short(Sdb_bson_arena &arena,
+                            const Sdb_field_encoder &encoder,
+                            const uchar *ptr) {
+  int32 value =
+      encoder.unsigned_flag ? (int32)uint2korr(ptr) : (int32)sint2korr(ptr);
+  return sdb_encode_int32(arena, encoder, value);
+}
+
+static int sdb_encode_medium(Sdb_bson_arena &arena,
+                             const Sdb_field_encoder &encoder,
+                             const uchar *ptr) {
+  int32 value =
+      encoder.unsigned_flag ? (int32)uint3korr(ptr) : (int32)sint3korr(ptr);
+  return sdb_encode_int32(arena, encoder, value);
+}
+
+static int sdb_encode_long(Sdb_bson_arena &arena,
+                           const Sdb_field_encoder &encoder, const uchar *ptr) {
+  if (encoder.unsigned_flag) {
+    uint32 value = uint4korr(ptr);
+    if (value > (uint32)INT_MAX32) {
+      // overflow, so store as INT64
+      return sdb_encode_int64(arena, encoder, (longlong)value);
+    }
+    return sdb_encode_int32(arena, encoder, (int32)value);
+  }
+  return sdb_encode_int32(arena, encoder, sint4korr(ptr));
+}
+
+static int sdb_encode_longlong(Sdb_bson_arena &arena,
+                               const Sdb_field_encoder &encoder,
+                               const uchar *ptr) {
+  longlong value = sint8korr(ptr);
+  if (value < 0 && encoder.unsigned_flag) {
+    // overflow, stored as DECIMAL by the generic way
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  return sdb_encode_int64(arena, encoder, value);
+}
+
+static int sdb_encode_float(Sdb_bson_arena &arena,
+                            const Sdb_field_encoder &encoder,
+                            const uchar *ptr) {
+  float value;
+  float4get(&value, ptr);
+  return sdb_encode_double(arena, encoder, (double)value);
+}
+
+static int sdb_encode_double_field(Sdb_bson_arena &arena,
+                                   const Sdb_field_encoder &encoder,
+                                   const uchar *ptr) {
+  double value;
+  float8get(&value, ptr);
+  return sdb_encode_double(arena, encoder, value);
+}
+
+static int sdb_encode_varchar(Sdb_bson_arena &arena,
+                              const Sdb_field_encoder &encoder,
+                              const uchar *ptr) {
+  uint32 length = (1 == encoder.length) ? (uint32)ptr[0] : uint2korr(ptr);
+  return sdb_encode_bytes(arena, encoder, (const char *)ptr + encoder.length,
+                          length);
+}
+
+static int sdb_encode_char(Sdb_bson_arena &arena,
+                           const Sdb_field_encoder &encoder, const uchar *ptr) {
+  // trailing spaces are stripped as Field_string::val_str() does
+  const CHARSET_INFO *cs = encoder.charset;
+  uint32 length =
+      (uint32)cs->cset->lengthsp(cs, (const char *)ptr, encoder.length);
+  return sdb_encode_bytes(arena, encoder, (const char *)ptr, length);
+}
+
+static int sdb_encode_blob(Sdb_bson_arena &arena,
+                           const Sdb_field_encoder &encoder, const uchar *ptr) {
+  uint32 length = 0;
+  const char *data = NULL;
+
+  switch (encoder.length) {
+    case 1:
+      length = (uint32)ptr[0];
+      break;
+    case 2:
+      length = uint2korr(ptr);
+      break;
+    case 3:
+      length = uint3korr(ptr);
+      break;
+    case 4:
+      length = uint4korr(ptr);
+      break;
+    default:
+      return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  memcpy(&data, ptr + encoder.length, sizeof(char *));
+  return sdb_encode_bytes(arena, encoder, data ? data : "", length);
+}
+
+static int sdb_encode_date(Sdb_bson_arena &arena,
+                           const Sdb_field_encoder &encoder, const uchar *ptr) {
+  // same layout as Field_newdate: day | month << 5 | year << 9
+  uint32 date_val = uint3korr(ptr);
+  time_t sec = sdb_mktime_date(date_val >> 9, (date_val >> 5) & 15,
+                               date_val & 31);
+  char *value = arena.append_element(bson::Date, encoder.name,
+                                     encoder.name_len, sizeof(longlong));
+  if (NULL == value) {
+    return HA_ERR_OUT_OF_MEM;
+  }
+  int8store(value, (longlong)sec * 1000);
+  return SDB_ERR_OK;
+}
+
+static int sdb_encode_decimal(Sdb_bson_arena &arena,
+                              const Sdb_field_encoder &encoder,
+                              const uchar *ptr) {
+  my_decimal dec;
+  char value[SDB_DECIMAL_VALUE_MAX_SIZE];
+  char *dst = NULL;
+  int size = 0;
+
+  if (E_DEC_OK != binary2my_decimal(0, ptr, &dec, encoder.precision,
+                                    encoder.decimals) ||
+      SDB_ERR_OK != sdb_decimal_to_bson_value(&dec, value, size)) {
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  dst = arena.append_element(bson::NumberDecimal, encoder.name,
+                             encoder.name_len, size);
+  if (NULL == dst) {
+    return HA_ERR_OUT_OF_MEM;
+  }
+  memcpy(dst, value, size);
+  return SDB_ERR_OK;
+}
+
+static int sdb_encode_datetime_packed(Sdb_bson_arena &arena,
+                                      const Sdb_field_encoder &encoder,
+                                      const uchar *ptr) {
+  return sdb_encode_int64(
+      arena, encoder, my_datetime_packed_from_binary(ptr, encoder.decimals));
+}
+
+Sdb_row_encoder::Sdb_row_encoder() : m_encoders(NULL), m_field_count(0) {}
+
+Sdb_row_encoder::~Sdb_row_encoder() {
+  release();
+}
+
+void Sdb_row_encoder::release() {
+  if (NULL != m_encoders) {
+    delete[] m_encoders;
+    m_encoders = NULL;
+  }
+  m_field_count = 0;
+}
+
+int Sdb_row_encoder::init(TABLE *table, bool datetime_as_int64) {
+  int rc = SDB_ERR_OK;
+  TABLE_SHARE *s = table->s;
+
+  release();
+  m_encoders = new (std::nothrow) Sdb_field_encoder[s->fields];
+  if (NULL == m_encoders) {
+    rc = HA_ERR_OUT_OF_MEM;
+    goto error;
+  }
+  m_field_count = s->fields;
+
+  for (uint i = 0; i < s->fields; ++i) {
+    Field *field = s->field[i];
+    Sdb_field_encoder &encoder = m_encoders[i];
+    bool is_str = false;
+
+    encoder.encode = NULL;
+    encoder.offset = (uint)(field->ptr - s->default_values);
+    encoder.null_offset =
+        field->null_ptr ? (uint)(field->null_ptr - s->default_values) : 0;
+    encoder.null_bit = field->null_ptr ? field->null_bit : 0;
+    encoder.unsigned_flag = (field->flags & UNSIGNED_FLAG) != 0;
+    encoder.pad_sensitive = false;
+    encoder.ascii_only = false;
+    encoder.length = 0;
+    encoder.precision = 0;
+    encoder.decimals = (uint8)field->decimals();
+    encoder.charset = field->charset();
+    encoder.name = field->field_name;
+    encoder.name_len = (uint)strlen(field->field_name);
+
+    switch (field->real_type()) {
+      case MYSQL_TYPE_TINY:
+        encoder.encode = sdb_encode_tiny;
+        break;
+      case MYSQL_TYPE_SHORT:
+        encoder.encode = sdb_encode_short;
+        break;
+      case MYSQL_TYPE_INT24:
+        encoder.encode = sdb_encode_medium;
+        break;
+      case MYSQL_TYPE_LONG:
+        encoder.encode = sdb_encode_long;
+        break;
+      case MYSQL_TYPE_LONGLONG:
+        encoder.encode = sdb_encode_longlong;
+        break;
+      case MYSQL_TYPE_FLOAT:
+        encoder.encode = sdb_encode_float;
+        break;
+      case MYSQL_TYPE_DOUBLE:
+        encoder.encode = sdb_encode_double_field;
+        break;
+      case MYSQL_TYPE_VARCHAR:
+        encoder.encode = sdb_encode_varchar;
+        encoder.length = ((Field_varstring *)field)->length_bytes;
+        is_str = true;
+        break;
+      case MYSQL_TYPE_STRING:
+        encoder.encode = sdb_encode_char;
+        encoder.length = field->field_length;
+        encoder.pad_sensitive = true;
+        is_str = true;
+        break;
+      case MYSQL_TYPE_TINY_BLOB:
+      case MYSQL_TYPE_MEDIUM_BLOB:
+      case MYSQL_TYPE_LONG_BLOB:
+      case MYSQL_TYPE_BLOB:
+        encoder.encode = sdb_encode_blob;
+        encoder.length = ((Field_blob *)field)->pack_length_no_ptr();
+        is_str = true;
+        break;
+      case MYSQL_TYPE_NEWDATE:
+        encoder.encode = sdb_encode_date;
+        break;
+      case MYSQL_TYPE_DATETIME2:
+        if (datetime_as_int64) {
+          encoder.encode = sdb_encode_datetime_packed;
+        }
+        break;
+      case MYSQL_TYPE_NEWDECIMAL:
+        encoder.encode = sdb_encode_decimal;
+        encoder.precision = (uint8)((Field_new_decimal *)field)->precision;
+        break;
+      default:
+        // DATETIME in string, JSON etc. are encoded by the generic way.
+        break;
+    }
+
+    // Strings in other charsets need to be converted by the generic way,
+    // unless the bytes keep the same in SDB_CHARSET.
+    if (is_str && !sdb_is_same_encoding(encoder.charset, &SDB_CHARSET)) {
+      if (my_charset_is_ascii_based(encoder.charset)) {
+        encoder.ascii_only = true;
+      } else {
+        encoder.encode = NULL;
+      }
+    }
+  }
+
+done:
+  return rc;
+error:
+  release();
+  goto done;
+}
+
+static inline int sdb_decode_int(const bson::BSONElement &elem,
+                                 const Sdb_field_decoder &decoder,
+                                 longlong &value) {
+  if (bson::NumberInt == elem.type()) {
+    value = elem._numberInt();
+  } else if (bson::NumberLong == elem.type()) {
+    value = elem._numberLong();
+  } else {
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  if (value < decoder.min_value || value > decoder.max_value) {
+    // out of range, let Field::store() handle it
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  return SDB_ERR_OK;
+}
+
+static inline int sdb_decode_str(const bson::BSONElement &elem,
+                                 const Sdb_field_decoder &decoder,
+                                 const char *&data, uint &length) {
+  int len = 0;
+  if (decoder.binary) {
+    if (bson::BinData != elem.type()) {
+      return SDB_ERR_TYPE_UNSUPPORTED;
+    }
+    data = elem.binData(len);
+  } else {
+    if (bson::String != elem.type()) {
+      return SDB_ERR_TYPE_UNSUPPORTED;
+    }
+    data = elem.valuestr();
+    len = elem.valuestrsize() - 1;
+  }
+  if (len < 0 || (uint)len > decoder.max_length) {
+    // may be truncated, let Field::store() handle it
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  if (decoder.ascii_only && !sdb_is_ascii(data, len)) {
+    // needs conversion
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  length = (uint)len;
+  return SDB_ERR_OK;
+}
+
+static int sdb_decode_tiny(const bson::BSONElement &elem,
+                           const Sdb_field_decoder &decoder, uchar *ptr,
+                           MEM_ROOT *blob_root) {
+  longlong value = 0;
+  int rc = sdb_decode_int(elem, decoder, value);
+  if (SDB_ERR_OK == rc) {
+    ptr[0] = (uchar)value;
+  }
+  return rc;
+}
+
+static int sdb_decode_short(const bson::BSONElement &elem,
+                            const Sdb_field_decoder &decoder, uchar *ptr,
+                            MEM_ROOT *blob_root) {
+  longlong value = 0;
+  int rc = sdb_decode_int(elem, decoder, value);
+  if (SDB_ERR_OK == rc) {
+    int2store(ptr, (uint16)value);
+  }
+  return rc;
+}
+
+static int sdb_decode_medium(const bson::BSONElement &elem,
+                             const Sdb_field_decoder &decoder, uchar *ptr,
+                             MEM_ROOT *blob_root) {
+  longlong value = 0;
+  int rc = sdb_decode_int(elem, decoder, value);
+  if (SDB_ERR_OK == rc) {
+    int3store(ptr, (uint32)value);
+  }
+  return rc;
+}
+
+static int sdb_decode_long(const bson::BSONElement &elem,
+                           const Sdb_field_decoder &decoder, uchar *ptr,
+                           MEM_ROOT *blob_root) {
+  longlong value = 0;
+  int rc = sdb_decode_int(elem, decoder, value);
+  if (SDB_ERR_OK == rc) {
+    int4store(ptr, (uint32)value);
+  }
+  return rc;
+}
+
+static int sdb_decode_longlong(const bson::BSONElement &elem,
+                               const Sdb_field_decoder &decoder, uchar *ptr,
+                               MEM_ROOT *blob_root) {
+  longlong value = 0;
+  int rc = sdb_decode_int(elem, decoder, value);
+  if (SDB_ERR_OK == rc) {
+    int8store(ptr, value);
+  }
+  return rc;
+}
+
+static int sdb_decode_float(const bson::BSONElement &elem,
+                            const Sdb_field_decoder &decoder, uchar *ptr,
+                            MEM_ROOT *blob_root) {
+  if (bson::NumberDouble != elem.type()) {
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  double value = elem._numberDouble();
+  if (!(value >= -FLT_MAX && value <= FLT_MAX)) {
+    // out of range or NaN
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  float nr = (float)value;
+  float4store(ptr, nr);
+  return SDB_ERR_OK;
+}
+
+static int sdb_decode_double(const bson::BSONElement &elem,
+                             const Sdb_field_decoder &decoder, uchar *ptr,
+                             MEM_ROOT *blob_root) {
+  if (bson::NumberDouble != elem.type()) {
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  double value = elem._numberDouble();
+  if (value != value) {
+    // NaN
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  float8store(ptr, value);
+  return SDB_ERR_OK;
+}
+
+static int sdb_decode_varchar(const bson::BSONElement &elem,
+                              const Sdb_field_decoder &decoder, uchar *ptr,
+                              MEM_ROOT *blob_root) {
+  const char *data = NULL;
+  uint length = 0;
+  int rc = sdb_decode_str(elem, decoder, data, length);
+  if (SDB_ERR_OK == rc) {
+    if (1 == decoder.length) {
+      ptr[0] = (uchar)length;
+    } else {
+      int2store(ptr, length);
+    }
+    memcpy(ptr + decoder.length, data, length);
+  }
+  return rc;
+}
+
+static int sdb_decode_char(const bson::BSONElement &elem,
+                           const Sdb_field_decoder &decoder, uchar *ptr,
+                           MEM_ROOT *blob_root) {
+  const char *data = NULL;
+  uint length = 0;
+  int rc = sdb_decode_str(elem, decoder, data, length);
+  if (SDB_ERR_OK == rc) {
+    memcpy(ptr, data, length);
+    memset(ptr + length, decoder.pad_char, decoder.length - length);
+  }
+  return rc;
+}
+
+static int sdb_decode_blob(const bson::BSONElement &elem,
+                           const Sdb_field_decoder &decoder, uchar *ptr,
+                           MEM_ROOT *blob_root) {
+  const char *data = NULL;
+  uchar *dst = NULL;
+  uint length = 0;
+  int rc = sdb_decode_str(elem, decoder, data, length);
+  if (SDB_ERR_OK != rc) {
+    goto error;
+  }
+
+  if (NULL == blob_root) {
+    // zero-copy, the object is pinned by caller
+    dst = (uchar *)data;
+  } else if (length > 0) {
+    dst = (uchar *)alloc_root(blob_root, length);
+    if (NULL == dst) {
+      rc = HA_ERR_OUT_OF_MEM;
+      goto error;
+    }
+    memcpy(dst, data, length);
+  }
+
+  switch (decoder.length) {
+    case 1:
+      ptr[0] = (uchar)length;
+      break;
+    case 2:
+      int2store(ptr, length);
+      break;
+    case 3:
+      int3store(ptr, length);
+      break;
+    case 4:
+      int4store(ptr, length);
+      break;
+    default:
+      rc = SDB_ERR_TYPE_UNSUPPORTED;
+      goto error;
+  }
+  memcpy(ptr + decoder.length, &dst, sizeof(uchar *));
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+static int sdb_decode_timestamp(const bson::BSONElement &elem,
+                                const Sdb_field_decoder &decoder, uchar *ptr,
+                                MEM_ROOT *blob_root) {
+  struct timeval tv;
+  longlong millisec = 0;
+  longlong microsec = 0;
+
+  if (bson::Timestamp != elem.type()) {
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  millisec = (longlong)elem.timestampTime();
+  microsec = elem.timestampInc();
+  if (millisec < 0 || millisec % 1000 != 0 || microsec < 0 ||
+      microsec >= 1000000) {
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  tv.tv_sec = (long)(millisec / 1000);
+  tv.tv_usec = (long)microsec;
+  if (my_time_fraction_remainder(tv.tv_usec, decoder.decimals)) {
+    // needs rounding, let Field::store_timestamp() handle it
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  my_timestamp_to_binary(&tv, ptr, decoder.decimals);
+  return SDB_ERR_OK;
+}
+
+static int sdb_decode_date(const bson::BSONElement &elem,
+                           const Sdb_field_decoder &decoder, uchar *ptr,
+                           MEM_ROOT *blob_root) {
+  uint year = 0, month = 0, day = 0;
+  if (bson::Date != elem.type()) {
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  sdb_localtime_date((time_t)((longlong)elem.date() / 1000), year, month, day);
+  if (year > 9999) {
+    // invalid date, let the generic way handle it
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  int3store(ptr, day | month << 5 | year << 9);
+  return SDB_ERR_OK;
+}
+
+static int sdb_decode_decimal(const bson::BSONElement &elem,
+                              const Sdb_field_decoder &decoder, uchar *ptr,
+                              MEM_ROOT *blob_root) {
+  my_decimal dec;
+  if (bson::NumberDecimal != elem.type() ||
+      SDB_ERR_OK != sdb_bson_value_to_decimal(elem.value(), &dec) ||
+      (decoder.unsigned_flag && dec.sign())) {
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  if (E_DEC_OK != my_decimal2binary(0, &dec, ptr, decoder.precision,
+                                    decoder.decimals)) {
+    // overflow or needs rounding, let Field::store() handle it
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  return SDB_ERR_OK;
+}
+
+static int sdb_decode_datetime_packed(const bson::BSONElement &elem,
+                                      const Sdb_field_decoder &decoder,
+                                      uchar *ptr, MEM_ROOT *blob_root) {
+  longlong packed = 0;
+  if (bson::NumberLong != elem.type()) {
+    // string of the old format, or others
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  packed = elem._numberLong();
+  if (my_time_fraction_remainder(MY_PACKED_TIME_GET_FRAC_PART(packed),
+                                 decoder.decimals)) {
+    // needs rounding, let Field::store_packed() handle it
+    return SDB_ERR_TYPE_UNSUPPORTED;
+  }
+  my_datetime_packed_to_binary(packed, ptr, decoder.decimals);
+  return SDB_ERR_OK;
+}
+
+Sdb_row_decoder::Sdb_row_decoder() : m_decoders(NULL), m_field_count(0) {}
+
+Sdb_row_decoder::~Sdb_row_decoder() {
+  release();
+}
+
+void Sdb_row_decoder::release() {
+  if (NULL != m_decoders) {
+    delete[] m_decoders;
+    m_decoders = NULL;
+  }
+  m_field_count = 0;
+}
+
+int Sdb_row_decoder::init(TABLE *table, bool datetime_as_int64) {
+  int rc = SDB_ERR_OK;
+  TABLE_SHARE *s = table->s;
+
+  release();
+  m_decoders = new (std::nothrow) Sdb_field_decoder[s->fields];
+  if (NULL == m_decoders) {
+    rc = HA_ERR_OUT_OF_MEM;
+    goto error;
+  }
+  m_field_count = s->fields;
+
+  for (uint i = 0; i < s->fields; ++i) {
+    Field *field = s->field[i];
+    Sdb_field_decoder &decoder = m_decoders[i];
+    const CHARSET_INFO *cs = field->charset();
+    bool is_unsigned = (field->flags & UNSIGNED_FLAG) != 0;
+    bool is_str = false;
+
+    decoder.decode = NULL;
+    decoder.min_value = 0;
+    decoder.max_value = 0;
+    decoder.binary = (&my_charset_bin == cs);
+    decoder.ascii_only = false;
+    decoder.length = 0;
+    decoder.max_length = 0;
+    decoder.pad_char = (uchar)cs->pad_char;
+    decoder.unsigned_flag = is_unsigned;
+    decoder.precision = 0;
+    decoder.decimals = (uint8)field->decimals();
+
+    switch (field->real_type()) {
+      case MYSQL_TYPE_TINY:
+        decoder.decode = sdb_decode_tiny;
+        decoder.min_value = is_unsigned ? 0 : INT_MIN8;
+        decoder.max_value = is_unsigned ? UINT_MAX8 : INT_MAX8;
+        break;
+      case MYSQL_TYPE_SHORT:
+        decoder.decode = sdb_decode_short;
+        decoder.min_value = is_unsigned ? 0 : INT_MIN16;
+        decoder.max_value = is_unsigned ? UINT_MAX16 : INT_MAX16;
+        break;
+      case MYSQL_TYPE_INT24:
+        decoder.decode = sdb_decode_medium;
+        decoder.min_value = is_unsigned ? 0 : INT_MIN24;
+        decoder.max_value = is_unsigned ? UINT_MAX24 : INT_MAX24;
+        break;
+      case MYSQL_TYPE_LONG:
+        decoder.decode = sdb_decode_long;
+        decoder.min_value = is_unsigned ? 0 : INT_MIN32;
+        decoder.max_value = is_unsigned ? (longlong)UINT_MAX32 : INT_MAX32;
+        break;
+      case MYSQL_TYPE_LONGLONG:
+        decoder.decode = sdb_decode_longlong;
+        decoder.min_value = is_unsigned ? 0 : LLONG_MIN;
+        decoder.max_value = LLONG_MAX;
+        break;
+      case MYSQL_TYPE_FLOAT:
+      case MYSQL_TYPE_DOUBLE:
+        // FLOAT(M,D) and UNSIGNED need rounding or clipping by Field::store()
+        if (!is_unsigned && field->decimals() >= NOT_FIXED_DEC) {
+          decoder.decode = (MYSQL_TYPE_FLOAT == field->real_type())
+                               ? sdb_decode_float
+                               : sdb_decode_double;
+        }
+        break;
+      case MYSQL_TYPE_VARCHAR:
+        decoder.decode = sdb_decode_varchar;
+        decoder.length = ((Field_varstring *)field)->length_bytes;
+        decoder.max_length = field->field_length / cs->mbmaxlen;
+        is_str = true;
+        break;
+      case MYSQL_TYPE_STRING:
+        decoder.decode = sdb_decode_char;
+        decoder.length = field->field_length;
+        decoder.max_length = field->field_length / cs->mbmaxlen;
+        is_str = true;
+        break;
+      case MYSQL_TYPE_TINY_BLOB:
+      case MYSQL_TYPE_MEDIUM_BLOB:
+      case MYSQL_TYPE_LONG_BLOB:
+      case MYSQL_TYPE_BLOB:
+        decoder.decode = sdb_decode_blob;
+        decoder.length = ((Field_blob *)field)->pack_length_no_ptr();
+        decoder.max_length = (uint)((Field_blob *)field)->max_data_length();
+        is_str = true;
+        break;
+      case MYSQL_TYPE_TIMESTAMP2:
+        decoder.decode = sdb_decode_timestamp;
+        break;
+      case MYSQL_TYPE_NEWDATE:
+        decoder.decode = sdb_decode_date;
+        break;
+      case MYSQL_TYPE_DATETIME2:
+        if (datetime_as_int64) {
+          decoder.decode = sdb_decode_datetime_packed;
+        }
+        break;
+      case MYSQL_TYPE_NEWDECIMAL:
+        decoder.decode = sdb_decode_decimal;
+        decoder.precision = (uint8)((Field_new_decimal *)field)->precision;
+        break;
+      default:
+        // DATETIME in string, JSON etc. are decoded by the generic way.
+        break;
+    }
+
+    // Strings in other charsets need to be converted by the generic way,
+    // unless they are pure ASCII.
+    if (is_str && !decoder.binary && !my_charset_same(cs, &SDB_CHARSET)) {
+      if (my_charset_is_ascii_based(cs)) {
+        decoder.ascii_only = true;
+      } else {
+        decoder.decode = NULL;
+      }
+    }
+  }
+
+done:
+  return rc;
+error:
+  release();
+  goto done;
+}
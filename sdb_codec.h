@@ -0,0 +1,183 @@
+/* Copyright (c) 2018, SequoiaDB and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#ifndef SDB_CODEC__H
+#define SDB_CODEC__H
+
+#include <sql_class.h>
+#include <vector>
+#include <client.hpp>
+
+/*
+  BSON objects built in place. The objects are appended to memory blocks,
+  which are kept and reused after reset(), so building objects allocates no
+  memory once the arena has grown to the working size. The objects refer to
+  the arena memory and are valid until reset().
+*/
+class Sdb_bson_arena {
+ public:
+  Sdb_bson_arena();
+  ~Sdb_bson_arena();
+
+  void reset();
+
+  void release();
+
+  int begin_obj();
+
+  int end_obj(bson::BSONObj &obj);
+
+  /*
+    Append the type and name of an element, and reserve value_size bytes for
+    its value.
+
+    @return the address of value, or NULL if out of memory
+  */
+  char *append_element(char type, const char *name, uint name_len,
+                       size_t value_size);
+
+  // Append an element already encoded.
+  int append_raw(const char *data, size_t size);
+
+ private:
+  char *reserve(size_t size);
+
+  bool next_block(size_t size);
+
+ private:
+  struct Block {
+    char *data;
+    size_t size;
+  };
+
+  std::vector<Block> m_blocks;
+  uint m_cur;          // index of current block
+  size_t m_used;       // used bytes of current block
+  size_t m_obj_start;  // offset of the object being built in current block
+};
+
+struct Sdb_field_encoder;
+
+/*
+  Encode the field value at ptr, which points into the record.
+
+  @retval SDB_ERR_TYPE_UNSUPPORTED  the value must be encoded by the generic
+                                    field_to_obj()
+*/
+typedef int (*Sdb_encode_func)(Sdb_bson_arena &arena,
+                               const Sdb_field_encoder &encoder,
+                               const uchar *ptr);
+
+struct Sdb_field_encoder {
+  Sdb_encode_func encode;  // NULL if only encoded by the generic way
+  uint offset;             // offset in the record
+  uint null_offset;        // offset of null byte in the record
+  uchar null_bit;          // 0 if not nullable
+  bool unsigned_flag;
+  bool pad_sensitive;  // CHAR value depends on PAD_CHAR_TO_FULL_LENGTH
+  bool ascii_only;     // string needs conversion unless it's pure ASCII
+  uint length;         // length bytes of VARCHAR, pack length of BLOB,
+                       // or field length of CHAR
+  uint8 precision;     // precision of DECIMAL
+  uint8 decimals;      // scale of DECIMAL, or fractional seconds precision
+                       // of DATETIME
+  const CHARSET_INFO *charset;
+  const char *name;
+  uint name_len;
+};
+
+/*
+  Encoding plan of a table, which is resolved once from TABLE_SHARE to a
+  type-specialized encode function per field.
+*/
+class Sdb_row_encoder {
+ public:
+  Sdb_row_encoder();
+  ~Sdb_row_encoder();
+
+  int init(TABLE *table, bool datetime_as_int64);
+
+  void release();
+
+  inline uint field_count() const { return m_field_count; }
+
+  inline const Sdb_field_encoder &operator[](uint i) const {
+    DBUG_ASSERT(i < m_field_count);
+    return m_encoders[i];
+  }
+
+ private:
+  Sdb_field_encoder *m_encoders;
+  uint m_field_count;
+};
+
+struct Sdb_field_decoder;
+
+/*
+  Decode the element into the field at ptr, which points into the record.
+  The data of BLOB is allocated from blob_root, or refers to the element if
+  blob_root is NULL, in which case the caller must keep the object alive.
+
+  @retval SDB_ERR_TYPE_UNSUPPORTED  the element must be decoded by the generic
+                                    bson_element_to_field()
+*/
+typedef int (*Sdb_decode_func)(const bson::BSONElement &elem,
+                               const Sdb_field_decoder &decoder, uchar *ptr,
+                               MEM_ROOT *blob_root);
+
+struct Sdb_field_decoder {
+  Sdb_decode_func decode;  // NULL if only decoded by the generic way
+  longlong min_value;      // value range of integer
+  longlong max_value;
+  bool binary;      // stored as BinData instead of String
+  bool ascii_only;  // string needs conversion unless it's pure ASCII
+  uint length;      // length bytes of VARCHAR, pack length of BLOB,
+                    // or field length of CHAR
+  uint max_length;  // max bytes of string stored without truncation
+  uchar pad_char;   // pad character of CHAR
+  bool unsigned_flag;
+  uint8 precision;  // precision of DECIMAL
+  uint8 decimals;   // scale of DECIMAL, or fractional seconds precision of
+                    // TIMESTAMP/DATETIME
+};
+
+/*
+  Decoding plan of a table, which is resolved once from TABLE_SHARE to a
+  type-specialized decode function per field. The decode functions write the
+  record in the storage format directly, and the generic Field::store() is
+  only used when the element is not of the expected type or range.
+*/
+class Sdb_row_decoder {
+ public:
+  Sdb_row_decoder();
+  ~Sdb_row_decoder();
+
+  int init(TABLE *table, bool datetime_as_int64);
+
+  void release();
+
+  inline uint field_count() const { return m_field_count; }
+
+  inline const Sdb_field_decoder &operator[](uint i) const {
+    DBUG_ASSERT(i < m_field_count);
+    return m_decoders[i];
+  }
+
+ private:
+  Sdb_field_decoder *m_decoders;
+  uint m_field_count;
+};
+
+#endif
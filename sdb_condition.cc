@@ -23,6 +23,8 @@
 Sdb_cond_ctx::Sdb_cond_ctx() {
   cur_item = NULL;
   status = SDB_COND_SUPPORTED;
+  need_recheck = false;
+  use_lob = false;
 }
 
 Sdb_cond_ctx::~Sdb_cond_ctx() {
@@ -160,6 +162,17 @@ void Sdb_cond_ctx::push(Item *item) {
   if (NULL != cur_item) {
     if (NULL == cond_item || (Item::FUNC_ITEM != cond_item->type() &&
                               Item::COND_ITEM != cond_item->type())) {
+      // A value stored in LOB is only an OID in the record, which never
+      // matches the condition on the value, see ha_sdb::is_lob_field().
+      if (use_lob && NULL != cond_item &&
+          Item::FIELD_ITEM == cond_item->type()) {
+        Field *field = ((Item_field *)cond_item)->field;
+        if (MYSQL_TYPE_BLOB == field->type() &&
+            !(field->flags & PART_KEY_FLAG)) {
+          rc = SDB_ERR_COND_UNEXPECTED_ITEM;
+          goto error;
+        }
+      }
       rc = cur_item->push_item(cond_item);
       if (0 != rc) {
         goto error;
@@ -287,6 +300,7 @@ int Sdb_cond_ctx::to_bson(bson::BSONObj &obj) {
   if (NULL != cur_item) {
     rc = cur_item->to_bson(obj);
     if (0 == rc) {
+      need_recheck = cur_item->inexact();
       goto done;
     }
     update_stat(rc);
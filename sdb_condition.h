@@ -52,6 +52,8 @@ class Sdb_cond_ctx : public Sql_alloc {
   Sdb_item *cur_item;
   List<Sdb_item> item_list;
   SDB_COND_STATUS status;
+  bool need_recheck;  // the condition matches more rows than cond_item
+  bool use_lob;       // BLOB/TEXT not in keys may be stored in LOBs
 };
 
 void sdb_parse_condtion(const Item *cond_item, Sdb_cond_ctx *sdb_cond);
@@ -22,18 +22,32 @@ static const char *SDB_PASSWORD_DFT = "";
 static const my_bool SDB_USE_PARTITION_DFT = TRUE;
 static const my_bool SDB_DEBUG_LOG_DFT = FALSE;
 static const my_bool SDB_DEFAULT_USE_BULK_INSERT = TRUE;
+static const my_bool SDB_DEFAULT_USE_ASYNC_BULK_INSERT = FALSE;
 static const my_bool SDB_DEFAULT_USE_AUTOCOMMIT = TRUE;
-static const int SDB_DEFAULT_BULK_INSERT_SIZE = 100;
+static const int SDB_DEFAULT_BULK_INSERT_SIZE = 10000;
+static const ulong SDB_DEFAULT_BULK_INSERT_MAX_BYTES = 32 * 1024 * 1024;
+static const int SDB_DEFAULT_BULK_INSERT_LATENCY = 100;
+static const int SDB_DEFAULT_BULK_DELETE_SIZE = 100;
+static const int SDB_DEFAULT_BULK_UPDATE_SIZE = 100;
 static const int SDB_DEFAULT_REPLICA_SIZE = -1;
+static const ulong SDB_DEFAULT_UNDO_LOG_MAX_BYTES = 16 * 1024 * 1024;
+static const ulong SDB_DEFAULT_AUTO_INCREMENT_CACHE_SIZE = 1000;
 
 char *sdb_conn_str = NULL;
 char *sdb_user = NULL;
 char *sdb_password = NULL;
 my_bool sdb_use_partition = SDB_USE_PARTITION_DFT;
 my_bool sdb_use_bulk_insert = SDB_DEFAULT_USE_BULK_INSERT;
+my_bool sdb_use_async_bulk_insert = SDB_DEFAULT_USE_ASYNC_BULK_INSERT;
 int sdb_bulk_insert_size = SDB_DEFAULT_BULK_INSERT_SIZE;
+ulong sdb_bulk_insert_max_bytes = SDB_DEFAULT_BULK_INSERT_MAX_BYTES;
+int sdb_bulk_insert_latency = SDB_DEFAULT_BULK_INSERT_LATENCY;
+int sdb_bulk_delete_size = SDB_DEFAULT_BULK_DELETE_SIZE;
+int sdb_bulk_update_size = SDB_DEFAULT_BULK_UPDATE_SIZE;
 int sdb_replica_size = SDB_DEFAULT_REPLICA_SIZE;
 my_bool sdb_use_autocommit = SDB_DEFAULT_USE_AUTOCOMMIT;
+ulong sdb_undo_log_max_bytes = SDB_DEFAULT_UNDO_LOG_MAX_BYTES;
+ulong sdb_auto_increment_cache_size = SDB_DEFAULT_AUTO_INCREMENT_CACHE_SIZE;
 my_bool sdb_debug_log = SDB_DEBUG_LOG_DFT;
 
 static String sdb_encoded_password;
@@ -85,11 +99,39 @@ static MYSQL_SYSVAR_BOOL(use_bulk_insert, sdb_use_bulk_insert,
                          PLUGIN_VAR_OPCMDARG,
                          "Enable bulk insert to SequoiaDB. Enabled by default.",
                          NULL, NULL, SDB_DEFAULT_USE_BULK_INSERT);
+static MYSQL_SYSVAR_BOOL(use_async_bulk_insert, sdb_use_async_bulk_insert,
+                         PLUGIN_VAR_OPCMDARG,
+                         "Send bulk insert in background while the next "
+                         "batch is being filled. Disabled by default.",
+                         NULL, NULL, SDB_DEFAULT_USE_ASYNC_BULK_INSERT);
 static MYSQL_SYSVAR_INT(bulk_insert_size, sdb_bulk_insert_size,
                         PLUGIN_VAR_OPCMDARG,
                         "Maximum number of records per bulk insert "
-                        "(Default: 100).",
+                        "(Default: 10000).",
                         NULL, NULL, SDB_DEFAULT_BULK_INSERT_SIZE, 1, 100000, 0);
+static MYSQL_SYSVAR_ULONG(bulk_insert_max_bytes, sdb_bulk_insert_max_bytes,
+                          PLUGIN_VAR_OPCMDARG,
+                          "Maximum bytes of records buffered by bulk insert "
+                          "of a session (Default: 32M).",
+                          NULL, NULL, SDB_DEFAULT_BULK_INSERT_MAX_BYTES,
+                          64 * 1024, 1024 * 1024 * 1024, 0);
+static MYSQL_SYSVAR_INT(bulk_insert_latency, sdb_bulk_insert_latency,
+                        PLUGIN_VAR_OPCMDARG,
+                        "Target latency in milliseconds of a bulk insert "
+                        "request, the batch size is adapted to it "
+                        "(Default: 100).",
+                        NULL, NULL, SDB_DEFAULT_BULK_INSERT_LATENCY, 1, 60000,
+                        0);
+static MYSQL_SYSVAR_INT(bulk_delete_size, sdb_bulk_delete_size,
+                        PLUGIN_VAR_OPCMDARG,
+                        "Maximum number of records per bulk delete "
+                        "(Default: 100).",
+                        NULL, NULL, SDB_DEFAULT_BULK_DELETE_SIZE, 1, 100000, 0);
+static MYSQL_SYSVAR_INT(bulk_update_size, sdb_bulk_update_size,
+                        PLUGIN_VAR_OPCMDARG,
+                        "Maximum number of records per bulk update "
+                        "(Default: 100).",
+                        NULL, NULL, SDB_DEFAULT_BULK_UPDATE_SIZE, 1, 100000, 0);
 static MYSQL_SYSVAR_INT(replica_size, sdb_replica_size, PLUGIN_VAR_OPCMDARG,
                         "Replica size of write operations "
                         "(Default: -1).",
@@ -99,6 +141,21 @@ static MYSQL_SYSVAR_BOOL(use_autocommit, sdb_use_autocommit,
                          "Enable autocommit of SequoiaDB storage engine. "
                          "Enabled by default.",
                          NULL, NULL, SDB_DEFAULT_USE_AUTOCOMMIT);
+static MYSQL_SYSVAR_ULONG(undo_log_max_bytes, sdb_undo_log_max_bytes,
+                          PLUGIN_VAR_OPCMDARG,
+                          "Maximum bytes of the undo log of a transaction, "
+                          "which rolls back a failed statement or to a "
+                          "savepoint without rolling back the whole "
+                          "transaction. 0 disables it (Default: 16M).",
+                          NULL, NULL, SDB_DEFAULT_UNDO_LOG_MAX_BYTES, 0,
+                          1024 * 1024 * 1024, 0);
+static MYSQL_SYSVAR_ULONG(auto_increment_cache_size,
+                          sdb_auto_increment_cache_size, PLUGIN_VAR_OPCMDARG,
+                          "Number of AUTO_INCREMENT values that a SQL node "
+                          "reserves from SequoiaDB at a time, and hands out "
+                          "from memory (Default: 1000).",
+                          NULL, NULL, SDB_DEFAULT_AUTO_INCREMENT_CACHE_SIZE,
+                          1, 1000000, 0);
 static MYSQL_SYSVAR_BOOL(debug_log, sdb_debug_log, PLUGIN_VAR_OPCMDARG,
                          "Turn on debug log of SequoiaDB storage engine. "
                          "Disabled by default.",
@@ -109,7 +166,11 @@ struct st_mysql_sys_var *sdb_sys_vars[] = {
     MYSQL_SYSVAR(password),        MYSQL_SYSVAR(use_partition),
     MYSQL_SYSVAR(use_bulk_insert), MYSQL_SYSVAR(bulk_insert_size),
     MYSQL_SYSVAR(replica_size),    MYSQL_SYSVAR(use_autocommit),
-    MYSQL_SYSVAR(debug_log),       NULL};
+    MYSQL_SYSVAR(debug_log),       MYSQL_SYSVAR(bulk_delete_size),
+    MYSQL_SYSVAR(bulk_update_size), MYSQL_SYSVAR(use_async_bulk_insert),
+    MYSQL_SYSVAR(bulk_insert_max_bytes), MYSQL_SYSVAR(bulk_insert_latency),
+    MYSQL_SYSVAR(undo_log_max_bytes), MYSQL_SYSVAR(auto_increment_cache_size),
+    NULL};
 
 Sdb_conn_addrs::Sdb_conn_addrs() : conn_num(0) {
   for (int i = 0; i < SDB_COORD_NUM_MAX; i++) {
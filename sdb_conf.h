@@ -53,9 +53,16 @@ extern char *sdb_conn_str;
 extern char *sdb_user;
 extern my_bool sdb_use_partition;
 extern my_bool sdb_use_bulk_insert;
+extern my_bool sdb_use_async_bulk_insert;
 extern int sdb_bulk_insert_size;
+extern ulong sdb_bulk_insert_max_bytes;
+extern int sdb_bulk_insert_latency;
+extern int sdb_bulk_delete_size;
+extern int sdb_bulk_update_size;
 extern int sdb_replica_size;
 extern my_bool sdb_use_autocommit;
+extern ulong sdb_undo_log_max_bytes;
+extern ulong sdb_auto_increment_cache_size;
 extern my_bool sdb_debug_log;
 extern st_mysql_sys_var *sdb_sys_vars[];
 
@@ -29,10 +29,100 @@
 #include "sdb_log.h"
 #include "ha_sdb.h"
 
+static const size_t SDB_UNDO_BATCH_SIZE = 1000;
+static const uint SDB_TRANS_ISO_UNKNOWN = ~0U;
+
 Sdb_conn::Sdb_conn(my_thread_id _tid)
-    : m_transaction_on(false), m_thread_id(_tid) {}
+    : m_transaction_on(false),
+      m_thread_id(_tid),
+      m_async_cl(NULL),
+      m_async_job(NULL),
+      m_worker_running(false),
+      m_worker_exit(false),
+      m_auto_rollback(true),
+      m_isolation(SDB_TRANS_ISO_UNKNOWN) {
+  clear_undo();
+}
+
+Sdb_conn::~Sdb_conn() {
+  wait_async();
+  if (m_worker_running) {
+    m_async_mutex.lock();
+    m_worker_exit = true;
+    m_async_cond.broadcast();
+    m_async_mutex.unlock();
+    my_thread_join(&m_async_worker, NULL);
+  }
+}
+
+void Sdb_conn::wait_async() {
+  if (NULL != m_async_cl) {
+    m_async_cl->join_async();
+  }
+}
+
+void *Sdb_conn::async_worker(void *arg) {
+  Sdb_conn *conn = static_cast<Sdb_conn *>(arg);
+
+  my_thread_init();
+  conn->m_async_mutex.lock();
+  while (!conn->m_worker_exit) {
+    Sdb_cl *cl = conn->m_async_job;
+    if (NULL == cl) {
+      conn->m_async_cond.wait(conn->m_async_mutex);
+      continue;
+    }
+    conn->m_async_mutex.unlock();
+    cl->run_async();
+    conn->m_async_mutex.lock();
+    conn->m_async_job = NULL;
+    conn->m_async_cond.broadcast();
+  }
+  conn->m_async_mutex.unlock();
+  my_thread_end();
+  return NULL;
+}
+
+int Sdb_conn::start_async(Sdb_cl *cl) {
+  int rc = SDB_ERR_OK;
+
+  DBUG_ASSERT(NULL == m_async_cl);
+
+  if (!m_worker_running) {
+    my_thread_attr_t attr;
+    my_thread_attr_init(&attr);
+    my_thread_attr_setdetachstate(&attr, MY_THREAD_CREATE_JOINABLE);
+    if (my_thread_create(&m_async_worker, &attr, async_worker, this)) {
+      rc = HA_ERR_OUT_OF_MEM;
+    } else {
+      m_worker_running = true;
+    }
+    my_thread_attr_destroy(&attr);
+    if (rc != SDB_ERR_OK) {
+      goto error;
+    }
+  }
 
-Sdb_conn::~Sdb_conn() {}
+  m_async_mutex.lock();
+  m_async_job = cl;
+  m_async_cl = cl;
+  m_async_cond.broadcast();
+  m_async_mutex.unlock();
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+void Sdb_conn::join_async() {
+  m_async_mutex.lock();
+  while (NULL != m_async_job) {
+    m_async_cond.wait(m_async_mutex);
+  }
+  m_async_mutex.unlock();
+  m_async_cl = NULL;
+}
 
 sdbclient::sdb &Sdb_conn::get_sdb() {
   return m_connection;
@@ -46,8 +136,16 @@ int Sdb_conn::connect() {
   int rc = SDB_ERR_OK;
   String password;
 
+  wait_async();
+
   if (!m_connection.isValid()) {
+    // The transaction is lost, and so is what it has done.
     m_transaction_on = false;
+    m_created_lobs.clear();
+    m_removed_lobs.clear();
+    clear_undo();
+    m_auto_rollback = true;
+    m_isolation = SDB_TRANS_ISO_UNKNOWN;
     Sdb_conn_addrs conn_addrs;
     rc = conn_addrs.parse_conn_addrs(sdb_conn_str);
     if (SDB_ERR_OK != rc) {
@@ -75,13 +173,53 @@ error:
   goto done;
 }
 
-int Sdb_conn::begin_transaction() {
+/*
+  With undo_log, SequoiaDB is told to keep the transaction on error, so that
+  a failed statement can be undone by the undo log. Otherwise the server
+  rolls back the transaction itself as usual. The attribute only matters to
+  the transactions begun later, so it's switched here when it differs.
+*/
+int Sdb_conn::begin_transaction(uint isolation, bool undo_log) {
   int rc = SDB_ERR_OK;
   int retry_times = 2;
+  bool auto_rollback = !(undo_log && sdb_undo_log_max_bytes > 0);
+
+  wait_async();
+
   while (!m_transaction_on) {
+    if (auto_rollback != m_auto_rollback) {
+      bson::BSONObj attr = BSON("TransAutoRollback" << auto_rollback);
+      rc = m_connection.setSessionAttr(attr);
+      if (IS_SDB_NET_ERR(rc) && --retry_times > 0) {
+        connect();
+        continue;
+      }
+      if (SDB_ERR_OK == rc) {
+        m_auto_rollback = auto_rollback;
+      } else {
+        SDB_LOG_WARNING("Failed to set TransAutoRollback, rc: %d", rc);
+      }
+    }
+
+    if (isolation != m_isolation) {
+      bson::BSONObj attr = BSON("TransIsolation" << (int)isolation);
+      rc = m_connection.setSessionAttr(attr);
+      if (IS_SDB_NET_ERR(rc) && --retry_times > 0) {
+        connect();
+        continue;
+      }
+      // The old server without the attribute runs in its own isolation.
+      if (SDB_ERR_OK != rc) {
+        SDB_LOG_WARNING("Failed to set transaction isolation %u, rc: %d",
+                        isolation, rc);
+      }
+      m_isolation = isolation;
+    }
+
     rc = m_connection.transactionBegin();
     if (SDB_ERR_OK == rc) {
       m_transaction_on = true;
+      m_undo_on = undo_log && !m_auto_rollback;
       break;
     } else if (IS_SDB_NET_ERR(rc) && --retry_times > 0) {
       connect();
@@ -99,13 +237,19 @@ error:
 
 int Sdb_conn::commit_transaction() {
   int rc = SDB_ERR_OK;
+
+  wait_async();
+
   if (m_transaction_on) {
     m_transaction_on = false;
     rc = m_connection.transactionCommit();
     if (rc != SDB_ERR_OK) {
       goto error;
     }
+    m_created_lobs.clear();
+    remove_lobs(m_removed_lobs);
   }
+  clear_undo();
 
 done:
   return rc;
@@ -118,6 +262,7 @@ error:
 }
 
 int Sdb_conn::rollback_transaction() {
+  wait_async();
   if (m_transaction_on) {
     int rc = SDB_ERR_OK;
     m_transaction_on = false;
@@ -125,14 +270,314 @@ int Sdb_conn::rollback_transaction() {
     if (IS_SDB_NET_ERR(rc)) {
       connect();
     }
+    m_removed_lobs.clear();
+    remove_lobs(m_created_lobs);
   }
+  clear_undo();
   return 0;
 }
 
+void Sdb_conn::add_lob_ref(std::vector<Sdb_lob_ref> &lobs,
+                           const char *cs_name, const char *cl_name,
+                           const bson::OID &oid) {
+  Sdb_lob_ref ref;
+  strmake(ref.cs_name, cs_name, SDB_CS_NAME_MAX_SIZE);
+  strmake(ref.cl_name, cl_name, SDB_CL_NAME_MAX_SIZE);
+  ref.oid = oid;
+  lobs.push_back(ref);
+}
+
+void Sdb_conn::add_created_lob(const char *cs_name, const char *cl_name,
+                               const bson::OID &oid) {
+  if (m_transaction_on) {
+    add_lob_ref(m_created_lobs, cs_name, cl_name, oid);
+  }
+}
+
+void Sdb_conn::remove_lob(const char *cs_name, const char *cl_name,
+                          const bson::OID &oid) {
+  if (m_transaction_on) {
+    add_lob_ref(m_removed_lobs, cs_name, cl_name, oid);
+  } else {
+    std::vector<Sdb_lob_ref> lobs;
+    add_lob_ref(lobs, cs_name, cl_name, oid);
+    remove_lobs(lobs);
+  }
+}
+
+/*
+  The LOBs are removed on a best-effort basis. A LOB failed to be removed is
+  only left orphaned, which doesn't affect the rows.
+*/
+void Sdb_conn::remove_lobs(std::vector<Sdb_lob_ref> &lobs) {
+  // lobs may be cleared by reconnecting during the removal
+  std::vector<Sdb_lob_ref> removing;
+  removing.swap(lobs);
+  for (std::vector<Sdb_lob_ref>::iterator it = removing.begin();
+       it != removing.end(); ++it) {
+    Sdb_cl cl;
+    int rc = get_cl(it->cs_name, it->cl_name, cl);
+    if (0 == rc) {
+      rc = cl.remove_lob(it->oid);
+    }
+    if (0 != rc) {
+      SDB_LOG_WARNING("Failed to remove LOB[%s] of collection[%s.%s], rc: %d",
+                      it->oid.toString().c_str(), it->cs_name, it->cl_name,
+                      rc);
+    }
+  }
+}
+
+void Sdb_conn::clear_undo() {
+  m_undo_on = false;
+  m_keep_undo = false;
+  m_undo_base = 0;
+  m_undo_bytes = 0;
+  m_undo_log.clear();
+  m_undo_cls.clear();
+  m_stmt_savepoint.undo_pos = 0;
+  m_stmt_savepoint.created_lobs = 0;
+  m_stmt_savepoint.removed_lobs = 0;
+}
+
+void Sdb_conn::add_undo(const char *cs_name, const char *cl_name,
+                        Sdb_undo_type type, const bson::OID *oid,
+                        const bson::BSONObj *obj) {
+  Sdb_undo_rec rec;
+  uint cl_idx = 0;
+
+  if (!m_undo_on) {
+    return;
+  }
+
+  // The record can't be put back without _id.
+  if (obj && bson::jstOID != obj->getField(SDB_OID_FIELD).type()) {
+    lose_undo();
+    return;
+  }
+
+  for (; cl_idx < m_undo_cls.size(); ++cl_idx) {
+    if (0 == strcmp(m_undo_cls[cl_idx].cs_name, cs_name) &&
+        0 == strcmp(m_undo_cls[cl_idx].cl_name, cl_name)) {
+      break;
+    }
+  }
+  if (m_undo_cls.size() == cl_idx) {
+    Sdb_cl_ref ref;
+    strmake(ref.cs_name, cs_name, SDB_CS_NAME_MAX_SIZE);
+    strmake(ref.cl_name, cl_name, SDB_CL_NAME_MAX_SIZE);
+    m_undo_cls.push_back(ref);
+  }
+
+  rec.cl_idx = cl_idx;
+  rec.type = type;
+  if (oid) {
+    rec.oid = *oid;
+  }
+  if (obj) {
+    rec.obj = obj->getOwned();
+  }
+
+  m_undo_bytes += sizeof(rec) + rec.obj.objsize();
+  if (m_undo_bytes > sdb_undo_log_max_bytes) {
+    lose_undo();
+    return;
+  }
+  m_undo_log.push_back(rec);
+}
+
+void Sdb_conn::log_insert(const char *cs_name, const char *cl_name,
+                          const bson::OID &oid) {
+  add_undo(cs_name, cl_name, SDB_UNDO_INSERT, &oid, NULL);
+}
+
+void Sdb_conn::log_delete(const char *cs_name, const char *cl_name,
+                          const bson::BSONObj &old_obj) {
+  add_undo(cs_name, cl_name, SDB_UNDO_DELETE, NULL, &old_obj);
+}
+
+void Sdb_conn::log_update(const char *cs_name, const char *cl_name,
+                          const bson::BSONObj &old_obj) {
+  add_undo(cs_name, cl_name, SDB_UNDO_UPDATE, NULL, &old_obj);
+}
+
+/*
+  The log is dropped, and the lost change takes a position of its own, so
+  that any savepoint before it is invalid.
+*/
+void Sdb_conn::lose_undo() {
+  m_undo_base += m_undo_log.size() + 1;
+  m_undo_bytes = 0;
+  m_undo_log.clear();
+  m_undo_cls.clear();
+}
+
+void Sdb_conn::set_savepoint(Sdb_savepoint &savepoint) {
+  savepoint.undo_pos = m_undo_base + m_undo_log.size();
+  savepoint.created_lobs = m_created_lobs.size();
+  savepoint.removed_lobs = m_removed_lobs.size();
+  m_keep_undo = true;
+}
+
+void Sdb_conn::release_stmt_savepoint() {
+  // Without savepoints of the user, the log of the statement is useless now.
+  if (!m_keep_undo && !m_undo_log.empty()) {
+    m_undo_base += m_undo_log.size();
+    m_undo_bytes = 0;
+    m_undo_log.clear();
+    m_undo_cls.clear();
+  }
+  m_stmt_savepoint.undo_pos = m_undo_base + m_undo_log.size();
+  m_stmt_savepoint.created_lobs = m_created_lobs.size();
+  m_stmt_savepoint.removed_lobs = m_removed_lobs.size();
+}
+
+int Sdb_conn::rollback_stmt() {
+  return rollback_to_savepoint(m_stmt_savepoint);
+}
+
+int Sdb_conn::rollback_to_savepoint(const Sdb_savepoint &savepoint) {
+  int rc = 0;
+  size_t begin = 0;
+
+  if (!m_undo_on || savepoint.undo_pos < m_undo_base) {
+    rc = HA_ERR_NO_SAVEPOINT;
+    goto done;
+  }
+
+  begin = (size_t)(savepoint.undo_pos - m_undo_base);
+  while (m_undo_log.size() > begin) {
+    rc = undo_last(begin);
+    if (rc != 0) {
+      lose_undo();
+      goto error;
+    }
+  }
+
+  // The removed records refer to their LOBs again, and the LOBs of the
+  // undone records are useless.
+  if (m_removed_lobs.size() > savepoint.removed_lobs) {
+    m_removed_lobs.resize(savepoint.removed_lobs);
+  }
+  if (m_created_lobs.size() > savepoint.created_lobs) {
+    std::vector<Sdb_lob_ref> lobs(
+        m_created_lobs.begin() + savepoint.created_lobs, m_created_lobs.end());
+    m_created_lobs.resize(savepoint.created_lobs);
+    remove_lobs(lobs);
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+/*
+  Undo the last records of the same collection and type in one request,
+  except the updates, which are undone one by one.
+*/
+int Sdb_conn::undo_last(size_t begin) {
+  int rc = 0;
+  Sdb_cl cl;
+  size_t end = m_undo_log.size();
+  size_t first = end - 1;
+  uint cl_idx = m_undo_log[first].cl_idx;
+  Sdb_undo_type type = m_undo_log[first].type;
+
+  if (type != SDB_UNDO_UPDATE) {
+    while (first > begin && end - first < SDB_UNDO_BATCH_SIZE &&
+           m_undo_log[first - 1].cl_idx == cl_idx &&
+           m_undo_log[first - 1].type == type) {
+      --first;
+    }
+  }
+
+  rc = get_cl(m_undo_cls[cl_idx].cs_name, m_undo_cls[cl_idx].cl_name, cl);
+  if (rc != 0) {
+    goto error;
+  }
+
+  switch (type) {
+    case SDB_UNDO_INSERT: {
+      std::vector<bson::OID> oids;
+      bson::BSONObj cond;
+      for (size_t i = first; i < end; ++i) {
+        oids.push_back(m_undo_log[i].oid);
+      }
+      sdb_build_oid_in_cond(oids, cond);
+      rc = cl.del(cond, BSON("" << SDB_OID_INDEX));
+      break;
+    }
+    case SDB_UNDO_DELETE: {
+      // The record is still there if the failed request didn't remove it.
+      std::vector<bson::BSONObj> objs;
+      for (size_t i = first; i < end; ++i) {
+        objs.push_back(m_undo_log[i].obj);
+      }
+      rc = cl.bulk_insert(FLG_INSERT_CONTONDUP, objs);
+      break;
+    }
+    case SDB_UNDO_UPDATE: {
+      const bson::BSONObj &old_obj = m_undo_log[first].obj;
+      bson::BSONObjBuilder cond_builder;
+      cond_builder.append(old_obj.getField(SDB_OID_FIELD));
+      rc = cl.update(BSON("$replace" << old_obj), cond_builder.obj(),
+                     BSON("" << SDB_OID_INDEX), UPDATE_KEEP_SHARDINGKEY);
+      break;
+    }
+    default:
+      DBUG_ASSERT(0);
+      break;
+  }
+  if (rc != 0) {
+    goto error;
+  }
+
+  for (size_t i = first; i < end; ++i) {
+    m_undo_bytes -= sizeof(Sdb_undo_rec) + m_undo_log[i].obj.objsize();
+  }
+  m_undo_log.resize(first);
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
 bool Sdb_conn::is_transaction_on() {
   return m_transaction_on;
 }
 
+int Sdb_conn::check_transaction() {
+  int rc = SDB_ERR_OK;
+  sdbclient::sdbCursor cursor;
+  bson::BSONObj obj;
+
+  DBUG_ASSERT(m_transaction_on);
+  wait_async();
+
+  // No retry, the transaction is lost with the connection.
+  rc = m_connection.getSnapshot(cursor, SDB_SNAP_TRANSACTIONS_CURRENT);
+  if (rc != SDB_ERR_OK) {
+    goto error;
+  }
+
+  rc = cursor.next(obj);
+  if (SDB_DMS_EOC == rc) {
+    // The transaction has been rolled back by the server.
+    rc = SDB_DPS_TRANS_NO_TRANS;
+  }
+  if (rc != SDB_ERR_OK) {
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  convert_sdb_code(rc);
+  goto done;
+}
+
 int Sdb_conn::get_cl(char *cs_name, char *cl_name, Sdb_cl &cl) {
   int rc = SDB_ERR_OK;
   cl.close();
@@ -162,6 +607,8 @@ int Sdb_conn::create_cl(char *cs_name, char *cl_name,
   bool new_cs = false;
   bool new_cl = false;
 
+  wait_async();
+
 retry:
   rc = m_connection.createCollectionSpace(cs_name, SDB_PAGESIZE_64K, cs);
   if (SDB_DMS_CS_EXIST == rc) {
@@ -215,6 +662,8 @@ int Sdb_conn::rename_cl(char *cs_name, char *old_cl_name, char *new_cl_name) {
   sdbclient::sdbCollectionSpace cs;
   sdbclient::sdbCollection cl;
 
+  wait_async();
+
 retry:
   rc = m_connection.getCollectionSpace(cs_name, cs);
   if (rc != SDB_ERR_OK) {
@@ -243,6 +692,8 @@ int Sdb_conn::drop_cl(char *cs_name, char *cl_name) {
   int retry_times = 2;
   sdbclient::sdbCollectionSpace cs;
 
+  wait_async();
+
 retry:
   rc = m_connection.getCollectionSpace(cs_name, cs);
   if (rc != SDB_ERR_OK) {
@@ -278,6 +729,9 @@ error:
 
 int Sdb_conn::drop_cs(char *cs_name) {
   int rc = SDB_ERR_OK;
+
+  wait_async();
+
   rc = m_connection.dropCollectionSpace(cs_name);
   if (rc != SDB_ERR_OK) {
     goto error;
@@ -332,6 +786,8 @@ int Sdb_conn::get_cl_statistics(char *cs_name, char *cl_name,
 
   std::string sql = ss.str();
 
+  wait_async();
+
 retry:
   rc = m_connection.exec(sql.c_str(), cursor);
   if (rc != SDB_ERR_OK) {
@@ -360,3 +816,48 @@ error:
   convert_sdb_code(rc);
   goto done;
 }
+
+int Sdb_conn::get_cl_sharding_key(char *cs_name, char *cl_name,
+                                  bson::BSONObj &sharding_key) {
+  int rc = SDB_ERR_OK;
+  sdbclient::sdbCursor cursor;
+  bson::BSONObj obj;
+  int retry_times = 2;
+  std::string full_name = std::string(cs_name) + "." + cl_name;
+
+  sharding_key = SDB_EMPTY_BSON;
+  wait_async();
+
+retry:
+  rc = m_connection.getSnapshot(cursor, SDB_SNAP_CATALOG,
+                                BSON("Name" << full_name));
+  if (SDB_RTN_COORD_ONLY == rc) {
+    // Collections of standalone SequoiaDB are never sharded.
+    rc = SDB_ERR_OK;
+    goto done;
+  }
+  if (rc != SDB_ERR_OK) {
+    goto error;
+  }
+
+  rc = cursor.next(obj);
+  if (SDB_DMS_EOC == rc) {
+    rc = SDB_ERR_OK;
+    goto done;
+  }
+  if (rc != SDB_ERR_OK) {
+    goto error;
+  }
+  sharding_key = obj.getObjectField("ShardingKey").getOwned();
+
+done:
+  return rc;
+error:
+  if (IS_SDB_NET_ERR(rc)) {
+    if (!m_transaction_on && retry_times-- > 0 && 0 == connect()) {
+      goto retry;
+    }
+  }
+  convert_sdb_code(rc);
+  goto done;
+}
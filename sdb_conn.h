@@ -18,12 +18,26 @@
 
 #include <my_global.h>
 #include <my_thread_local.h>
+#include <vector>
 #include <client.hpp>
 #include "sdb_def.h"
+#include "sdb_lock.h"
 
 class Sdb_cl;
 class Sdb_statistics;
 
+// Isolation levels of SequoiaDB transaction
+#define SDB_TRANS_ISO_RU 0  // read uncommitted
+#define SDB_TRANS_ISO_RC 1  // read committed
+#define SDB_TRANS_ISO_RS 2  // read stability
+
+// Position in the undo log and the LOB lists of a transaction.
+struct Sdb_savepoint {
+  ulonglong undo_pos;
+  size_t created_lobs;
+  size_t removed_lobs;
+};
+
 class Sdb_conn {
  public:
   Sdb_conn(my_thread_id _tid);
@@ -36,7 +50,11 @@ class Sdb_conn {
 
   my_thread_id thread_id();
 
-  int begin_transaction();
+  /*
+    The isolation level is set to the session when it's changed. The undo
+    log is used by the transaction if undo_log, see is_undo_on().
+  */
+  int begin_transaction(uint isolation, bool undo_log = false);
 
   int commit_transaction();
 
@@ -44,6 +62,12 @@ class Sdb_conn {
 
   bool is_transaction_on();
 
+  /*
+    Ask the server whether the transaction of the session is still alive,
+    it costs a round trip.
+  */
+  int check_transaction();
+
   int get_cl(char *cs_name, char *cl_name, Sdb_cl &cl);
 
   int create_cl(char *cs_name, char *cl_name,
@@ -58,12 +82,134 @@ class Sdb_conn {
 
   int get_cl_statistics(char *cs_name, char *cl_name, Sdb_statistics &stats);
 
+  // Get the ShardingKey of the collection, empty if it isn't sharded.
+  int get_cl_sharding_key(char *cs_name, char *cl_name,
+                          bson::BSONObj &sharding_key);
+
   inline bool is_valid() { return m_connection.isValid(); }
 
+  /*
+    Wait for the request running in background, it must be done before
+    anything else is sent through the connection.
+  */
+  void wait_async();
+
+  /*
+    Run the background request of cl by the worker thread of the connection,
+    which is created at the first request and kept until the connection is
+    destroyed. The caller must run the request itself if it fails.
+  */
+  int start_async(Sdb_cl *cl);
+
+  // Wait for the worker to finish the request.
+  void join_async();
+
+  /*
+    LOBs are not covered by transaction. The LOBs created in the transaction
+    are removed on rollback, and the LOBs to be removed are kept until
+    commit, so that a rolled back row still refers to its LOB. Out of
+    transaction, the LOB is removed at once.
+  */
+  void add_created_lob(const char *cs_name, const char *cl_name,
+                       const bson::OID &oid);
+
+  void remove_lob(const char *cs_name, const char *cl_name,
+                  const bson::OID &oid);
+
+  /*
+    SequoiaDB can only roll back the whole transaction. So in an explicit
+    transaction, the changes are logged to undo a failed statement or to
+    roll back to a savepoint by compensating requests: the inserted records
+    are removed by _id, the removed records are inserted again, and the
+    updated records are replaced by their old images. The log is bounded by
+    sequoiadb_undo_log_max_bytes. When it overflows or a change can't be
+    undone, the savepoints before are lost.
+  */
+  inline bool is_undo_on() { return m_undo_on; }
+
+  void log_insert(const char *cs_name, const char *cl_name,
+                  const bson::OID &oid);
+
+  void log_delete(const char *cs_name, const char *cl_name,
+                  const bson::BSONObj &old_obj);
+
+  void log_update(const char *cs_name, const char *cl_name,
+                  const bson::BSONObj &old_obj);
+
+  // A change which can't be undone is made.
+  void lose_undo();
+
+  void set_savepoint(Sdb_savepoint &savepoint);
+
+  /*
+    @retval HA_ERR_NO_SAVEPOINT  the changes since the savepoint can't be
+                                 undone, and nothing is done
+  */
+  int rollback_to_savepoint(const Sdb_savepoint &savepoint);
+
+  // The statement savepoint is moved at the end of each statement.
+  void release_stmt_savepoint();
+
+  int rollback_stmt();
+
+ private:
+  struct Sdb_lob_ref {
+    char cs_name[SDB_CS_NAME_MAX_SIZE + 1];
+    char cl_name[SDB_CL_NAME_MAX_SIZE + 1];
+    bson::OID oid;
+  };
+
+  struct Sdb_cl_ref {
+    char cs_name[SDB_CS_NAME_MAX_SIZE + 1];
+    char cl_name[SDB_CL_NAME_MAX_SIZE + 1];
+  };
+
+  enum Sdb_undo_type { SDB_UNDO_INSERT, SDB_UNDO_DELETE, SDB_UNDO_UPDATE };
+
+  struct Sdb_undo_rec {
+    uint cl_idx;  // index in m_undo_cls
+    Sdb_undo_type type;
+    bson::OID oid;      // _id of the inserted record
+    bson::BSONObj obj;  // old image of the removed or updated record
+  };
+
+  void add_lob_ref(std::vector<Sdb_lob_ref> &lobs, const char *cs_name,
+                   const char *cl_name, const bson::OID &oid);
+
+  void remove_lobs(std::vector<Sdb_lob_ref> &lobs);
+
+  void add_undo(const char *cs_name, const char *cl_name, Sdb_undo_type type,
+                const bson::OID *oid, const bson::BSONObj *obj);
+
+  int undo_last(size_t begin);
+
+  void clear_undo();
+
+ private:
+  static void *async_worker(void *arg);
+
  private:
   sdbclient::sdb m_connection;
   bool m_transaction_on;
   my_thread_id m_thread_id;
+  Sdb_cl *m_async_cl;  // collection with a background request
+  Sdb_cl *m_async_job;  // request to be run by the worker, NULL when done
+  Sdb_mutex m_async_mutex;
+  Sdb_cond m_async_cond;
+  my_thread_handle m_async_worker;
+  bool m_worker_running;
+  bool m_worker_exit;
+  std::vector<Sdb_lob_ref> m_created_lobs;
+  std::vector<Sdb_lob_ref> m_removed_lobs;
+  bool m_auto_rollback;  // SequoiaDB rolls back the transaction on error
+  uint m_isolation;      // isolation level of the session
+  bool m_undo_on;
+  bool m_keep_undo;       // keep the log for savepoints of the user
+  ulonglong m_undo_base;  // position of the first record in m_undo_log
+  ulonglong m_undo_bytes;
+  std::vector<Sdb_undo_rec> m_undo_log;
+  std::vector<Sdb_cl_ref> m_undo_cls;
+  Sdb_savepoint m_stmt_savepoint;
 };
 
 #endif
@@ -26,6 +26,17 @@
 
 #define SDB_CHARSET my_charset_utf8mb4_bin
 
+#define SDB_COMMENT "sequoiadb"
+
+#define SDB_OID_FIELD "_id"
+#define SDB_OID_INDEX "$id"
+
+// separator of table name and partition name in the name of partition
+#define SDB_PART_SEP "#P#"
+
+// LOB is read and written in chunks of the size
+#define SDB_LOB_CHUNK_SIZE (1024 * 1024)
+
 const static bson::BSONObj SDB_EMPTY_BSON;
 
 #endif
@@ -150,9 +150,9 @@ static void get_int_key_obj(const uchar *key_ptr, const KEY_PART_INFO *key_part,
   if (value < 0 && ((Field_num *)field)->unsigned_flag) {
     // overflow UINT64, so store as DECIMAL
     bson::bsonDecimal decimal_val;
-    char buf[24] = {0};
-    sprintf(buf, "%llu", (uint64)value);
-    decimal_val.fromString(buf);
+    my_decimal dec_val;
+    ulonglong2decimal((ulonglong)value, &dec_val);
+    sdb_decimal_to_bson(&dec_val, decimal_val);
     obj_builder.append(op_str, decimal_val);
   } else if (value > INT_MAX32 || value < INT_MIN32) {
     // overflow INT32, so store as INT64
@@ -183,7 +183,21 @@ static void get_decimal_key_obj(const uchar *key_ptr,
   bson::BSONObjBuilder obj_builder;
   String str_val;
   const uchar *new_ptr = key_ptr + key_part->store_length - key_part->length;
-  key_part->field->val_str(&str_val, new_ptr);
+  Field *field = key_part->field;
+  if (MYSQL_TYPE_NEWDECIMAL == field->real_type()) {
+    my_decimal dec_val;
+    bson::bsonDecimal decimal_val;
+    if (E_DEC_OK ==
+            binary2my_decimal(0, new_ptr, &dec_val,
+                              ((Field_new_decimal *)field)->precision,
+                              field->decimals()) &&
+        0 == sdb_decimal_to_bson(&dec_val, decimal_val)) {
+      obj_builder.append(op_str, decimal_val);
+      obj = obj_builder.obj();
+      return;
+    }
+  }
+  field->val_str(&str_val, new_ptr);
   obj_builder.appendDecimal(op_str, str_val.c_ptr());
   obj = obj_builder.obj();
 }
@@ -292,25 +306,15 @@ static void get_date_key_obj(const uchar *key_ptr,
                              const KEY_PART_INFO *key_part, const char *op_str,
                              bson::BSONObj &obj) {
   bson::BSONObjBuilder obj_builder;
-  struct tm tm_val;
   Field *field = key_part->field;
   const uchar *new_ptr = key_ptr + key_part->store_length - key_part->length;
   const uchar *old_ptr = field->ptr;
   field->ptr = (uchar *)new_ptr;
   longlong date_val = ((Field_newdate *)field)->val_int();
   field->ptr = (uchar *)old_ptr;
-  tm_val.tm_sec = 0;
-  tm_val.tm_min = 0;
-  tm_val.tm_hour = 0;
-  tm_val.tm_mday = date_val % 100;
-  date_val = date_val / 100;
-  tm_val.tm_mon = date_val % 100 - 1;
-  date_val = date_val / 100;
-  tm_val.tm_year = date_val - 1900;
-  tm_val.tm_wday = 0;
-  tm_val.tm_yday = 0;
-  tm_val.tm_isdst = 0;
-  time_t time_tmp = mktime(&tm_val);
+  time_t time_tmp =
+      sdb_mktime_date((uint)(date_val / 10000), (uint)(date_val / 100 % 100),
+                      (uint)(date_val % 100));
   bson::Date_t dt((longlong)(time_tmp * 1000));
   obj_builder.appendDate(op_str, dt);
   obj = obj_builder.obj();
@@ -318,9 +322,20 @@ static void get_date_key_obj(const uchar *key_ptr,
 
 static void get_datetime_key_obj(const uchar *key_ptr,
                                  const KEY_PART_INFO *key_part,
-                                 const char *op_str, bson::BSONObj &obj) {
+                                 const char *op_str, bool as_int64,
+                                 bson::BSONObj &obj) {
   bson::BSONObjBuilder obj_builder;
   const uchar *new_ptr = key_ptr + key_part->store_length - key_part->length;
+  if (as_int64) {
+    Field *field = key_part->field;
+    const uchar *old_ptr = field->ptr;
+    field->ptr = (uchar *)new_ptr;
+    longlong packed = field->val_date_temporal();
+    field->ptr = (uchar *)old_ptr;
+    obj_builder.append(op_str, (long long)packed);
+    obj = obj_builder.obj();
+    return;
+  }
   String org_str, str_val;
   key_part->field->val_str(&org_str, new_ptr);
   sdb_convert_charset(org_str, str_val, &SDB_CHARSET);
@@ -354,7 +369,8 @@ static void get_timestamp_key_obj(const uchar *key_ptr,
 
 static int get_key_part_value(const KEY_PART_INFO *key_part,
                               const uchar *key_ptr, const char *op_str,
-                              bool ignore_text_key, bson::BSONObj &obj) {
+                              bool ignore_text_key, bool datetime_as_int64,
+                              bson::BSONObj &obj) {
   int rc = SDB_ERR_OK;
 
   switch (key_part->field->type()) {
@@ -384,7 +400,7 @@ static int get_key_part_value(const KEY_PART_INFO *key_part,
       break;
     }
     case MYSQL_TYPE_DATETIME: {
-      get_datetime_key_obj(key_ptr, key_part, op_str, obj);
+      get_datetime_key_obj(key_ptr, key_part, op_str, datetime_as_int64, obj);
       break;
     }
     case MYSQL_TYPE_TIMESTAMP: {
@@ -437,12 +453,13 @@ error:
 
 static inline int create_condition(Field *field, const KEY_PART_INFO *key_part,
                                    const uchar *key_ptr, const char *op_str,
-                                   bool ignore_text_key,
+                                   bool ignore_text_key, bool datetime_as_int64,
                                    bson::BSONArrayBuilder &builder) {
   int rc = SDB_ERR_OK;
   bson::BSONObj op_obj;
 
-  rc = get_key_part_value(key_part, key_ptr, op_str, ignore_text_key, op_obj);
+  rc = get_key_part_value(key_part, key_ptr, op_str, ignore_text_key,
+                          datetime_as_int64, op_obj);
   if (SDB_ERR_OK == rc) {
     if (!op_obj.isEmpty()) {
       bson::BSONObj cond = BSON(field->field_name << op_obj);
@@ -458,6 +475,7 @@ int sdb_create_condition_from_key(TABLE *table, KEY *key_info,
                                   const key_range *start_key,
                                   const key_range *end_key,
                                   bool from_records_in_range, bool eq_range_arg,
+                                  bool datetime_as_int64,
                                   bson::BSONObj &condition) {
   int rc = SDB_ERR_OK;
   const uchar *key_ptr;
@@ -533,7 +551,7 @@ int sdb_create_condition_from_key(TABLE *table, KEY *key_info,
           DBUG_PRINT("info", ("sequoiadb HA_READ_KEY_EXACT %d", i));
           const char *op_str = from_records_in_range ? "$gte" : "$et";
           rc = create_condition(field, key_part, key_ptr, op_str,
-                                ignore_text_key, builder);
+                                ignore_text_key, datetime_as_int64, builder);
           if (0 != rc) {
             goto error;
           }
@@ -549,7 +567,7 @@ int sdb_create_condition_from_key(TABLE *table, KEY *key_info,
             // end_key : start_key
             const char *op_str = i > 0 ? "$lte" : "$gt";
             rc = create_condition(field, key_part, key_ptr, op_str,
-                                  ignore_text_key, builder);
+                                  ignore_text_key, datetime_as_int64, builder);
             if (0 != rc) {
               goto error;
             }
@@ -560,7 +578,7 @@ int sdb_create_condition_from_key(TABLE *table, KEY *key_info,
           DBUG_PRINT("info", ("sequoiadb HA_READ_KEY_OR_NEXT %d", i));
           const char *op_str = "$gte";
           rc = create_condition(field, key_part, key_ptr, op_str,
-                                ignore_text_key, builder);
+                                ignore_text_key, datetime_as_int64, builder);
           if (0 != rc) {
             goto error;
           }
@@ -571,7 +589,7 @@ int sdb_create_condition_from_key(TABLE *table, KEY *key_info,
           if (store_length >= length) {
             const char *op_str = "$lt";
             rc = create_condition(field, key_part, key_ptr, op_str,
-                                  ignore_text_key, builder);
+                                  ignore_text_key, datetime_as_int64, builder);
             if (0 != rc) {
               goto error;
             }
@@ -584,7 +602,7 @@ int sdb_create_condition_from_key(TABLE *table, KEY *key_info,
           DBUG_PRINT("info", ("sequoiadb HA_READ_KEY_OR_PREV %d", i));
           const char *op_str = "$lte";
           rc = create_condition(field, key_part, key_ptr, op_str,
-                                ignore_text_key, builder);
+                                ignore_text_key, datetime_as_int64, builder);
           if (0 != rc) {
             goto error;
           }
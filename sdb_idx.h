@@ -28,6 +28,7 @@ int sdb_create_condition_from_key(TABLE *table, KEY *key_info,
                                   const key_range *start_key,
                                   const key_range *end_key,
                                   bool from_records_in_range, bool eq_range_arg,
+                                  bool datetime_as_int64,
                                   bson::BSONObj &condition);
 
 int sdb_get_key_direction(ha_rkey_function find_flag);
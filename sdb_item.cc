@@ -79,6 +79,9 @@ int Sdb_logic_item::push_sdb_item(Sdb_item *cond_item) {
     is_ok = FALSE;
     goto error;
   }
+  if (cond_item->inexact()) {
+    is_inexact = TRUE;
+  }
   delete cond_item;
   children.append(obj_tmp);
 
@@ -246,12 +249,9 @@ int Sdb_func_item::get_item_val(const char *field_name, Item *item_val,
           if (val_tmp < 0 && item_val->unsigned_flag) {
             bson::bsonDecimal decimal;
             my_decimal dec_tmp;
-            char buff[MAX_FIELD_WIDTH] = {0};
-            String str(buff, sizeof(buff), item_val->charset_for_protocol());
-            item_val->val_decimal(&dec_tmp);
-            my_decimal2string(E_DEC_FATAL_ERROR, &dec_tmp, 0, 0, 0, &str);
+            ulonglong2decimal((ulonglong)val_tmp, &dec_tmp);
 
-            rc = decimal.fromString(str.c_ptr());
+            rc = sdb_decimal_to_bson(&dec_tmp, decimal);
             if (0 != rc) {
               rc = SDB_ERR_INVALID_ARG;
               goto error;
@@ -283,6 +283,16 @@ int Sdb_func_item::get_item_val(const char *field_name, Item *item_val,
           } else if (MYSQL_TYPE_DOUBLE == field->type()) {
             double value = item_val->val_real();
             BSON_APPEND(field_name, value, obj, arr_builder);
+          } else if (DECIMAL_RESULT == item_val->result_type()) {
+            bson::bsonDecimal decimal;
+            my_decimal dec_tmp;
+            my_decimal *dec_val = item_val->val_decimal(&dec_tmp);
+            if (NULL == dec_val || 0 != sdb_decimal_to_bson(dec_val, decimal)) {
+              rc = SDB_ERR_INVALID_ARG;
+              goto error;
+            }
+
+            BSON_APPEND(field_name, decimal, obj, arr_builder);
           } else {
             bson::bsonDecimal decimal;
             char buff[MAX_FIELD_WIDTH] = {0};
@@ -411,17 +421,9 @@ int Sdb_func_item::get_item_val(const char *field_name, Item *item_val,
       }
       if (STRING_RESULT == item_val->result_type() &&
           !item_val->get_date(&ltime, flags)) {
-        struct tm tm_val;
-        tm_val.tm_sec = ltime.second;
-        tm_val.tm_min = ltime.minute;
-        tm_val.tm_hour = ltime.hour;
-        tm_val.tm_mday = ltime.day;
-        tm_val.tm_mon = ltime.month - 1;
-        tm_val.tm_year = ltime.year - 1900;
-        tm_val.tm_wday = 0;
-        tm_val.tm_yday = 0;
-        tm_val.tm_isdst = 0;
-        time_t time_tmp = mktime(&tm_val);
+        time_t time_tmp =
+            sdb_mktime_date(ltime.year, ltime.month, ltime.day) +
+            ltime.hour * 3600 + ltime.minute * 60 + ltime.second;
         bson::Date_t dt((longlong)(time_tmp * 1000));
         BSON_APPEND(field_name, dt, obj, arr_builder);
       } else {
@@ -469,6 +471,10 @@ int Sdb_func_item::get_item_val(const char *field_name, Item *item_val,
           ltime.year < 1000) {
         rc = SDB_ERR_COND_UNEXPECTED_ITEM;
         goto error;
+      } else if (sdb_is_datetime_as_int64(field->table->s->comment.str)) {
+        // datetime is stored as packed int64
+        long long packed = TIME_to_longlong_datetime_packed(&ltime);
+        BSON_APPEND(field_name, packed, obj, arr_builder);
       } else {
         uint dec = field->decimals();
         char buff[MAX_FIELD_WIDTH];
@@ -699,6 +705,14 @@ int Sdb_func_cmp::to_bson_with_child(bson::BSONObj &obj) {
   }
   field3 = para_list.pop();
 
+  if (0 == strcmp(func->func_name(), "json_extract")) {
+    rc = json_path_to_bson(field1, field2, field3, obj);
+    if (rc != SDB_ERR_OK) {
+      goto error;
+    }
+    goto done;
+  }
+
   if (Item::FIELD_ITEM == field1->type()) {
     if (Item::FIELD_ITEM == field2->type()) {
       if (!(field3->const_item()) || (0 != strcmp(func->func_name(), "-") &&
@@ -880,6 +894,143 @@ error:
   goto done;
 }
 
+/*
+  Get the field name of a JSON path like '$.a.b' on field doc, which is
+  'doc.a.b' in native BSON. Only the path of object members is supported.
+*/
+static int sdb_json_path_to_name(const char *field_name, const char *path,
+                                 size_t length, std::string &name) {
+  int rc = SDB_ERR_OK;
+  size_t i = 0;
+
+  if (length < 2 || '$' != path[0]) {
+    rc = SDB_ERR_COND_UNEXPECTED_ITEM;
+    goto error;
+  }
+
+  name = field_name;
+  for (i = 1; i < length;) {
+    size_t begin = 0;
+    if ('.' != path[i++]) {
+      rc = SDB_ERR_COND_UNEXPECTED_ITEM;
+      goto error;
+    }
+    begin = i;
+    while (i < length && (my_isalnum(&my_charset_latin1, path[i]) ||
+                          '_' == path[i])) {
+      ++i;
+    }
+    if (begin == i || my_isdigit(&my_charset_latin1, path[begin])) {
+      rc = SDB_ERR_COND_UNEXPECTED_ITEM;
+      goto error;
+    }
+    name.append(".").append(path + begin, i - begin);
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+/*
+  json_extract(doc, '$.a') = value is pushed down as {'doc.a': value} on the
+  JSON stored as native BSON. The JSON stored in binary can't be matched by
+  path, so it's matched by type, and MySQL checks the rows again.
+*/
+int Sdb_func_cmp::json_path_to_bson(Item *json_item, Item *path_item,
+                                    Item *value_item, bson::BSONObj &obj) {
+  int rc = SDB_ERR_OK;
+  Field *field = NULL;
+  String path_buf;
+  String *path = NULL;
+  std::string name;
+  bson::BSONObjBuilder value_builder;
+  bson::BSONObj binary_cond;
+
+  if (Item_func::EQ_FUNC != type() || Item::FIELD_ITEM != json_item->type() ||
+      !path_item->const_item() || !value_item->const_item()) {
+    rc = SDB_ERR_COND_UNEXPECTED_ITEM;
+    goto error;
+  }
+
+  field = ((Item_field *)json_item)->field;
+  if (MYSQL_TYPE_JSON != field->type()) {
+    rc = SDB_ERR_COND_UNEXPECTED_ITEM;
+    goto error;
+  }
+
+  path = path_item->val_str(&path_buf);
+  if (NULL == path) {
+    rc = SDB_ERR_COND_UNEXPECTED_ITEM;
+    goto error;
+  }
+  rc = sdb_json_path_to_name(field->field_name, path->ptr(), path->length(),
+                             name);
+  if (rc != SDB_ERR_OK) {
+    goto error;
+  }
+
+  switch (value_item->result_type()) {
+    case INT_RESULT: {
+      longlong value = value_item->val_int();
+      if (value < 0 && value_item->unsigned_flag) {
+        rc = SDB_ERR_COND_UNEXPECTED_ITEM;
+        goto error;
+      }
+      value_builder.append("$et", (long long)value);
+      break;
+    }
+    case REAL_RESULT: {
+      value_builder.append("$et", value_item->val_real());
+      break;
+    }
+    case STRING_RESULT: {
+      // The string is compared as JSON string, unless it's JSON or temporal.
+      char buff[MAX_FIELD_WIDTH];
+      String str(buff, sizeof(buff), value_item->collation.collation);
+      String conv_str;
+      String *str_val = NULL;
+      if (MYSQL_TYPE_JSON == value_item->field_type() ||
+          value_item->is_temporal()) {
+        rc = SDB_ERR_COND_UNEXPECTED_ITEM;
+        goto error;
+      }
+      str_val = value_item->val_str(&str);
+      if (NULL == str_val) {
+        rc = SDB_ERR_COND_UNEXPECTED_ITEM;
+        goto error;
+      }
+      rc = sdb_convert_charset(*str_val, conv_str, &SDB_CHARSET);
+      if (rc != SDB_ERR_OK) {
+        rc = SDB_ERR_COND_UNEXPECTED_ITEM;
+        goto error;
+      }
+      value_builder.appendStrWithNoTerminating("$et", conv_str.ptr(),
+                                               conv_str.length());
+      break;
+    }
+    default: {
+      rc = SDB_ERR_COND_UNEXPECTED_ITEM;
+      goto error;
+    }
+  }
+  if (value_item->null_value) {
+    rc = SDB_ERR_COND_UNEXPECTED_ITEM;
+    goto error;
+  }
+
+  binary_cond = BSON("$type" << 1 << "$et" << (int)bson::BinData);
+  obj = BSON("$or" << BSON_ARRAY(BSON(name << value_builder.obj())
+                                 << BSON(field->field_name << binary_cond)));
+  is_inexact = TRUE;
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
 int Sdb_func_cmp::to_bson(bson::BSONObj &obj) {
   int rc = SDB_ERR_OK;
   bool inverse = FALSE;
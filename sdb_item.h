@@ -23,7 +23,7 @@
 
 class Sdb_item : public Sql_alloc {
  public:
-  Sdb_item() : is_finished(FALSE) {}
+  Sdb_item() : is_finished(FALSE), is_inexact(FALSE) {}
   virtual ~Sdb_item(){};
 
   virtual int push_sdb_item(Sdb_item *cond_item) {
@@ -35,11 +35,15 @@ class Sdb_item : public Sql_alloc {
   virtual int to_bson(bson::BSONObj &obj) = 0;
   virtual const char *name() = 0;
   virtual bool finished() { return is_finished; };
+  // The condition matches more rows than the item, which must be checked
+  // again by MySQL.
+  bool inexact() { return is_inexact; }
 
   virtual Item_func::Functype type() = 0;
 
  protected:
   bool is_finished;
+  bool is_inexact;
 };
 
 class Sdb_logic_item : public Sdb_item {
@@ -171,6 +175,10 @@ class Sdb_func_cmp : public Sdb_func_bin_op {
   virtual const char *name() = 0;
   virtual const char *inverse_name() = 0;
   virtual Item_func::Functype type() = 0;
+
+ private:
+  int json_path_to_bson(Item *json_item, Item *path_item, Item *value_item,
+                        bson::BSONObj &obj);
 };
 
 class Sdb_func_eq : public Sdb_func_cmp {
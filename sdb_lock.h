@@ -18,8 +18,10 @@
 
 #include <thr_mutex.h>
 #include <thr_rwlock.h>
+#include <thr_cond.h>
 
 class Sdb_mutex {
+  friend class Sdb_cond;
   native_mutex_t m_mutex;
 
  public:
@@ -41,6 +43,21 @@ class Sdb_mutex_guard {
   ~Sdb_mutex_guard() { m_mutex.unlock(); }
 };
 
+class Sdb_cond {
+  native_cond_t m_cond;
+
+ public:
+  Sdb_cond() { native_cond_init(&m_cond); }
+
+  ~Sdb_cond() { native_cond_destroy(&m_cond); }
+
+  inline int wait(Sdb_mutex &mutex) {
+    return native_cond_wait(&m_cond, &mutex.m_mutex);
+  }
+
+  inline int broadcast() { return native_cond_broadcast(&m_cond); }
+};
+
 class Sdb_rwlock {
   native_rw_lock_t rw_lock;
 
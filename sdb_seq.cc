@@ -0,0 +1,284 @@
+/* Copyright (c) 2018, SequoiaDB and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#ifndef MYSQL_SERVER
+#define MYSQL_SERVER
+#endif
+
+#include "sdb_seq.h"
+#include <my_base.h>
+#include "sdb_cl.h"
+#include "sdb_conn.h"
+#include "sdb_errcode.h"
+#include "sdb_lock.h"
+#include "sdb_log.h"
+
+#define SDB_SEQ_CL_NAME "sequoiasql_auto_increment"
+#define SDB_SEQ_FIELD_TABLE "Table"
+#define SDB_SEQ_FIELD_NEXT "Next"
+
+static Sdb_mutex sdb_seq_mutex;
+static Sdb_conn sdb_seq_conn(0);
+
+/*
+  Get the sequence collection of cs_name on the dedicated connection, the
+  caller must hold sdb_seq_mutex.
+
+  @retval HA_ERR_KEY_NOT_FOUND  the collection doesn't exist, and isn't
+                                created
+*/
+static int sdb_seq_get_cl(char *cs_name, Sdb_cl &cl, bool create) {
+  int rc = 0;
+  char cl_name[] = SDB_SEQ_CL_NAME;
+  bool created_cl = false;
+
+  if (!sdb_seq_conn.is_valid()) {
+    rc = sdb_seq_conn.connect();
+    if (0 != rc) {
+      goto error;
+    }
+  }
+
+  rc = sdb_seq_conn.get_cl(cs_name, cl_name, cl);
+  if (SDB_DMS_NOTEXIST == get_sdb_code(rc) ||
+      SDB_DMS_CS_NOTEXIST == get_sdb_code(rc)) {
+    if (!create) {
+      rc = HA_ERR_KEY_NOT_FOUND;
+      goto error;
+    }
+    rc = sdb_seq_conn.create_cl(cs_name, cl_name, SDB_EMPTY_BSON, NULL,
+                                &created_cl);
+    if (0 != rc) {
+      goto error;
+    }
+    rc = sdb_seq_conn.get_cl(cs_name, cl_name, cl);
+    if (0 != rc) {
+      goto error;
+    }
+    rc = cl.create_index(BSON(SDB_SEQ_FIELD_TABLE << 1), SDB_SEQ_FIELD_TABLE,
+                         true, true);
+    if (0 != rc) {
+      SDB_LOG_ERROR("Failed to create index of %s.%s, rc=%d", cs_name,
+                    cl_name, rc);
+      goto error;
+    }
+  } else if (0 != rc) {
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+int sdb_seq_set(char *cs_name, const char *table_name, ulonglong next) {
+  int rc = 0;
+  Sdb_cl cl;
+  Sdb_mutex_guard guard(sdb_seq_mutex);
+
+  rc = sdb_seq_get_cl(cs_name, cl, true);
+  if (0 != rc) {
+    goto error;
+  }
+
+  rc = cl.upsert(BSON("$set" << BSON(SDB_SEQ_FIELD_NEXT << (longlong)next)),
+                 BSON(SDB_SEQ_FIELD_TABLE << table_name));
+  if (0 != rc) {
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+int sdb_seq_init(char *cs_name, const char *table_name, ulonglong next) {
+  int rc = 0;
+  Sdb_cl cl;
+  bson::BSONObj obj;
+  Sdb_mutex_guard guard(sdb_seq_mutex);
+
+  rc = sdb_seq_get_cl(cs_name, cl, true);
+  if (0 != rc) {
+    goto error;
+  }
+
+  obj = BSON(SDB_SEQ_FIELD_TABLE << table_name << SDB_SEQ_FIELD_NEXT
+                                 << (longlong)next);
+  rc = cl.insert(obj);
+  // Another SQL node has created it.
+  if (SDB_IXM_DUP_KEY == get_sdb_code(rc)) {
+    rc = 0;
+  }
+  if (0 != rc) {
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+int sdb_seq_reserve(char *cs_name, const char *table_name, ulonglong count,
+                    ulonglong &first) {
+  int rc = 0;
+  Sdb_cl cl;
+  bson::BSONObj old_obj;
+  Sdb_mutex_guard guard(sdb_seq_mutex);
+
+  rc = sdb_seq_get_cl(cs_name, cl, false);
+  if (0 != rc) {
+    goto error;
+  }
+
+  rc = cl.query_and_update_one(
+      BSON("$inc" << BSON(SDB_SEQ_FIELD_NEXT << (longlong)count)),
+      BSON(SDB_SEQ_FIELD_TABLE << table_name),
+      BSON("" << SDB_SEQ_FIELD_TABLE), QUERY_WITH_RETURNDATA, &old_obj);
+  if (HA_ERR_END_OF_FILE == rc) {
+    rc = HA_ERR_KEY_NOT_FOUND;
+  }
+  if (0 != rc) {
+    goto error;
+  }
+  first = (ulonglong)old_obj.getField(SDB_SEQ_FIELD_NEXT).numberLong();
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+int sdb_seq_raise(char *cs_name, const char *table_name, ulonglong next,
+                  ulonglong &old_next) {
+  int rc = 0;
+  Sdb_cl cl;
+  bson::BSONObj obj;
+  Sdb_mutex_guard guard(sdb_seq_mutex);
+
+  old_next = 0;
+  rc = sdb_seq_get_cl(cs_name, cl, false);
+  if (0 != rc) {
+    goto error;
+  }
+
+  // Others may have raised it further, which is kept.
+  rc = cl.query_and_update_one(
+      BSON("$set" << BSON(SDB_SEQ_FIELD_NEXT << (longlong)next)),
+      BSON(SDB_SEQ_FIELD_TABLE << table_name << SDB_SEQ_FIELD_NEXT
+                               << BSON("$lt" << (longlong)next)),
+      BSON("" << SDB_SEQ_FIELD_TABLE), QUERY_WITH_RETURNDATA, &obj);
+  if (0 == rc) {
+    old_next = (ulonglong)obj.getField(SDB_SEQ_FIELD_NEXT).numberLong();
+    goto done;
+  }
+  if (HA_ERR_END_OF_FILE != rc) {
+    goto error;
+  }
+
+  // Nothing is updated either if the record is missing.
+  rc = cl.query_one(obj, BSON(SDB_SEQ_FIELD_TABLE << table_name));
+  if (SDB_DMS_EOC == get_sdb_code(rc)) {
+    rc = HA_ERR_KEY_NOT_FOUND;
+  }
+  if (0 != rc) {
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+int sdb_seq_get(char *cs_name, const char *table_name, ulonglong &next) {
+  int rc = 0;
+  Sdb_cl cl;
+  bson::BSONObj obj;
+  Sdb_mutex_guard guard(sdb_seq_mutex);
+
+  rc = sdb_seq_get_cl(cs_name, cl, false);
+  if (0 != rc) {
+    goto error;
+  }
+
+  rc = cl.query_one(obj, BSON(SDB_SEQ_FIELD_TABLE << table_name));
+  if (SDB_DMS_EOC == get_sdb_code(rc)) {
+    rc = HA_ERR_KEY_NOT_FOUND;
+  }
+  if (0 != rc) {
+    goto error;
+  }
+  next = (ulonglong)obj.getField(SDB_SEQ_FIELD_NEXT).numberLong();
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+int sdb_seq_rename(char *cs_name, const char *old_name, const char *new_name) {
+  int rc = 0;
+  Sdb_cl cl;
+  Sdb_mutex_guard guard(sdb_seq_mutex);
+
+  rc = sdb_seq_get_cl(cs_name, cl, false);
+  if (HA_ERR_KEY_NOT_FOUND == rc) {
+    rc = 0;
+    goto done;
+  }
+  if (0 != rc) {
+    goto error;
+  }
+
+  rc = cl.update(BSON("$set" << BSON(SDB_SEQ_FIELD_TABLE << new_name)),
+                 BSON(SDB_SEQ_FIELD_TABLE << old_name));
+  if (0 != rc) {
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+int sdb_seq_remove(char *cs_name, const char *table_name) {
+  int rc = 0;
+  Sdb_cl cl;
+  Sdb_mutex_guard guard(sdb_seq_mutex);
+
+  rc = sdb_seq_get_cl(cs_name, cl, false);
+  if (HA_ERR_KEY_NOT_FOUND == rc) {
+    rc = 0;
+    goto done;
+  }
+  if (0 != rc) {
+    goto error;
+  }
+
+  rc = cl.del(BSON(SDB_SEQ_FIELD_TABLE << table_name));
+  if (0 != rc) {
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
@@ -0,0 +1,64 @@
+/* Copyright (c) 2018, SequoiaDB and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#ifndef SDB_SEQ__H
+#define SDB_SEQ__H
+
+#include <my_global.h>
+
+/*
+  AUTO_INCREMENT values of tables are kept in a sequence collection of each
+  database, one record {Table: <table name>, Next: <next value>} per table.
+  Values are reserved in ranges by atomic $inc on a connection dedicated to
+  sequences. The reservation is out of the transactions of sessions, so it
+  never waits for them and is never rolled back, and no two SQL nodes get the
+  same value.
+*/
+
+// Set the next value of table, the record is created if not exists.
+int sdb_seq_set(char *cs_name, const char *table_name, ulonglong next);
+
+// Create the record of table with the next value, if not exists.
+int sdb_seq_init(char *cs_name, const char *table_name, ulonglong next);
+
+/*
+  Reserve count values of table, and return the first one.
+
+  @retval HA_ERR_KEY_NOT_FOUND  the table has no record
+*/
+int sdb_seq_reserve(char *cs_name, const char *table_name, ulonglong count,
+                    ulonglong &first);
+
+/*
+  Raise the next value of table to next, if it's less than next.
+
+  @param[out] old_next  the next value before raising, or 0 if not raised
+  @retval HA_ERR_KEY_NOT_FOUND  the table has no record
+*/
+int sdb_seq_raise(char *cs_name, const char *table_name, ulonglong next,
+                  ulonglong &old_next);
+
+/*
+  Get the next value of table.
+
+  @retval HA_ERR_KEY_NOT_FOUND  the table has no record
+*/
+int sdb_seq_get(char *cs_name, const char *table_name, ulonglong &next);
+
+int sdb_seq_rename(char *cs_name, const char *old_name, const char *new_name);
+
+int sdb_seq_remove(char *cs_name, const char *table_name);
+
+#endif
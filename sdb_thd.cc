@@ -23,6 +23,83 @@
 #include "sdb_thd.h"
 #include "sdb_log.h"
 #include "sdb_errcode.h"
+#include "sdb_conf.h"
+
+static const ulonglong SDB_BATCH_MIN_BYTES = 64 * 1024;
+static const ulonglong SDB_BATCH_INIT_BYTES = 1024 * 1024;
+
+Sdb_batch_ctrl::Sdb_batch_ctrl()
+    : m_target_bytes(SDB_BATCH_INIT_BYTES),
+      m_buffered_bytes(0),
+      m_peak_bytes(0),
+      m_last_throughput(0),
+      m_growing(true) {}
+
+ulonglong Sdb_batch_ctrl::target_bytes(ulonglong max_bytes) const {
+  return m_target_bytes < max_bytes ? m_target_bytes : max_bytes;
+}
+
+void Sdb_batch_ctrl::feedback(ulonglong bytes, ulonglong usecs, int rc,
+                              ulonglong max_bytes) {
+  int sdb_rc = get_sdb_code(rc);
+  ulonglong latency = (ulonglong)sdb_bulk_insert_latency * 1000;
+
+  if (rc != 0) {
+    if (SDB_TIMEOUT == sdb_rc || IS_SDB_NET_ERR(sdb_rc)) {
+      m_target_bytes /= 2;
+      m_last_throughput = 0;
+      m_growing = false;
+    }
+    goto done;
+  }
+
+  // A batch cut by the row limit or the end of statement tells nothing about
+  // the byte size.
+  if (bytes < target_bytes(max_bytes) / 2) {
+    goto done;
+  }
+
+  if (0 == usecs) {
+    usecs = 1;
+  }
+
+  if (usecs > latency) {
+    m_target_bytes = (ulonglong)((double)m_target_bytes * latency / usecs);
+    m_growing = false;
+  } else {
+    // Hill climbing: keep the direction while the throughput improves.
+    double throughput = (double)bytes / usecs;
+    if (throughput < m_last_throughput) {
+      m_growing = !m_growing;
+    }
+    if (m_growing) {
+      m_target_bytes += m_target_bytes / 2;
+    } else {
+      m_target_bytes -= m_target_bytes / 4;
+    }
+    m_last_throughput = throughput;
+  }
+
+done:
+  if (m_target_bytes > max_bytes) {
+    m_target_bytes = max_bytes;
+  }
+  if (m_target_bytes < SDB_BATCH_MIN_BYTES) {
+    m_target_bytes = SDB_BATCH_MIN_BYTES;
+  }
+}
+
+void Sdb_batch_ctrl::buffer(ulonglong bytes) {
+  m_buffered_bytes += bytes;
+  if (m_buffered_bytes > m_peak_bytes) {
+    m_peak_bytes = m_buffered_bytes;
+  }
+}
+
+void Sdb_batch_ctrl::release(ulonglong bytes) {
+  DBUG_ASSERT(m_buffered_bytes >= bytes);
+  m_buffered_bytes = m_buffered_bytes > bytes ? m_buffered_bytes - bytes : 0;
+}
 
 Thd_sdb::Thd_sdb(THD* thd)
     : m_thd(thd),
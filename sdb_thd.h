@@ -22,6 +22,38 @@
 
 extern handlerton* sdb_hton;
 
+/*
+  Adaptive byte size of bulk insert batches. The batch keeps growing while
+  the throughput improves and the latency of request is under target, and
+  shrinks when the target latency is exceeded or the request times out.
+  It also counts the bytes buffered by all bulk inserts of the session,
+  which are capped by sequoiadb_bulk_insert_max_bytes.
+*/
+class Sdb_batch_ctrl {
+ public:
+  Sdb_batch_ctrl();
+
+  ulonglong target_bytes(ulonglong max_bytes) const;
+
+  inline ulonglong peak_bytes() const { return m_peak_bytes; }
+
+  // Bytes buffered, including the batches in flight.
+  inline ulonglong buffered_bytes() const { return m_buffered_bytes; }
+
+  void buffer(ulonglong bytes);
+
+  void release(ulonglong bytes);
+
+  void feedback(ulonglong bytes, ulonglong usecs, int rc, ulonglong max_bytes);
+
+ private:
+  ulonglong m_target_bytes;
+  ulonglong m_buffered_bytes;
+  ulonglong m_peak_bytes;  // peak of m_buffered_bytes
+  double m_last_throughput;  // bytes per microsecond
+  bool m_growing;
+};
+
 class Thd_sdb {
  private:
   Thd_sdb(THD* thd);
@@ -40,6 +72,7 @@ class Thd_sdb {
   uint lock_count;
   uint start_stmt_count;
   uint save_point_count;
+  Sdb_batch_ctrl bulk_insert_ctrl;
 
  private:
   THD* m_thd;
@@ -19,6 +19,19 @@
 #include "sdb_errcode.h"
 #include "sdb_def.h"
 #include <my_rnd.h>
+#include <my_atomic.h>
+#include <json_dom.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define SDB_DATETIME_FORMAT "datetime_format"
+#define SDB_LOB_THRESHOLD "lob_threshold"
+#define SDB_SHARDING_KEY "sharding_key"
+#define SDB_SHARDING_TYPE "sharding_type"
+#define SDB_PARTITION "partition"
+#define SDB_PARTITION_MIN 8
+#define SDB_PARTITION_MAX 1048576
 
 int sdb_parse_table_name(const char *from, char *db_name, int db_name_max_size,
                          char *table_name, int table_name_max_size) {
@@ -27,6 +40,7 @@ int sdb_parse_table_name(const char *from, char *db_name, int db_name_max_size,
   char *end = NULL;
   char *ptr = NULL;
   char *tmp_name = NULL;
+  char *part_sep = NULL;
   char tmp_buff[SDB_CL_NAME_MAX_SIZE + SDB_CS_NAME_MAX_SIZE + 1];
 
   tmp_name = tmp_buff;
@@ -44,7 +58,21 @@ int sdb_parse_table_name(const char *from, char *db_name, int db_name_max_size,
   }
   memcpy(tmp_name, ptr + 1, end - ptr);
   tmp_name[name_len] = '\0';
+  // Each partition is a collection named with the suffix like "#P#p0", which
+  // is kept as is instead of being garbled by the conversion.
+  part_sep = strstr(tmp_name, SDB_PART_SEP);
+  if (part_sep) {
+    *part_sep = '\0';
+  }
   filename_to_tablename(tmp_name, table_name, sizeof(tmp_buff) - 1);
+  if (part_sep) {
+    *part_sep = '#';
+    if (strlen(table_name) + strlen(part_sep) > (size_t)table_name_max_size) {
+      rc = ER_TOO_LONG_IDENT;
+      goto error;
+    }
+    strcat(table_name, part_sep);
+  }
 
   // scan db_name
   ptr--;
@@ -142,6 +170,11 @@ int sdb_convert_charset(const String &src_str, String &dst_str,
                         const CHARSET_INFO *dst_charset) {
   int rc = SDB_ERR_OK;
   uint conv_errors = 0;
+  if (sdb_is_same_in_charset(src_str.ptr(), src_str.length(),
+                             src_str.charset(), dst_charset)) {
+    dst_str.set(src_str.ptr(), src_str.length(), dst_charset);
+    goto done;
+  }
   if (dst_str.copy(src_str.ptr(), src_str.length(), src_str.charset(),
                    dst_charset, &conv_errors)) {
     rc = HA_ERR_OUT_OF_MEM;
@@ -160,6 +193,53 @@ error:
   goto done;
 }
 
+bool sdb_is_ascii(const char *data, size_t length) {
+  const char *end = data + length;
+#ifdef __SSE2__
+  for (; data + 16 <= end; data += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)data);
+    if (_mm_movemask_epi8(chunk)) {
+      return false;
+    }
+  }
+#endif
+  for (; data + 8 <= end; data += 8) {
+    uint64 word = 0;
+    memcpy(&word, data, sizeof(word));
+    if (word & 0x8080808080808080ULL) {
+      return false;
+    }
+  }
+  for (; data < end; ++data) {
+    if (*data & 0x80) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool sdb_is_same_encoding(const CHARSET_INFO *src_charset,
+                          const CHARSET_INFO *dst_charset) {
+  if (src_charset == dst_charset || &my_charset_bin == src_charset ||
+      &my_charset_bin == dst_charset ||
+      my_charset_same(src_charset, dst_charset)) {
+    return true;
+  }
+  // utf8 is the subset of utf8mb4 in the same encoding
+  return 0 == strcmp(src_charset->csname, "utf8") &&
+         0 == strcmp(dst_charset->csname, "utf8mb4");
+}
+
+bool sdb_is_same_in_charset(const char *data, size_t length,
+                            const CHARSET_INFO *src_charset,
+                            const CHARSET_INFO *dst_charset) {
+  if (sdb_is_same_encoding(src_charset, dst_charset)) {
+    return true;
+  }
+  return my_charset_is_ascii_based(src_charset) &&
+         my_charset_is_ascii_based(dst_charset) && sdb_is_ascii(data, length);
+}
+
 bool sdb_field_is_floating(enum_field_types type) {
   switch (type) {
     case MYSQL_TYPE_DOUBLE:
@@ -189,6 +269,771 @@ bool sdb_field_is_date_time(enum_field_types type) {
   }
 }
 
+static const longlong SDB_SECS_PER_DAY = 86400;
+static const uint SDB_MIN_CACHED_YEAR = 1;
+static const uint SDB_MAX_CACHED_YEAR = 9999;
+
+/*
+  UTC offset of the local midnights of each year, as mktime() with
+  tm_isdst = 0 returns. 0 means unknown yet, SDB_YEAR_OFFSET_NONUNIFORM means
+  the offset changes within the year so libc must be used, others are
+  offset * 2 + 1. The server time zone is fixed after startup, so the
+  entries are filled once and never change.
+*/
+static const int32 SDB_YEAR_OFFSET_UNKNOWN = 0;
+static const int32 SDB_YEAR_OFFSET_NONUNIFORM = 2;
+static int32 sdb_year_offsets[SDB_MAX_CACHED_YEAR + 1];
+
+// Days since 1970-01-01 of the proleptic Gregorian date.
+static longlong sdb_days_from_civil(longlong year, uint month, uint day) {
+  year -= (month <= 2) ? 1 : 0;
+  longlong era = (year >= 0 ? year : year - 399) / 400;
+  longlong yoe = year - era * 400;
+  longlong doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  longlong doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static void sdb_civil_from_days(longlong days, longlong &year, uint &month,
+                                uint &day) {
+  days += 719468;
+  longlong era = (days >= 0 ? days : days - 146096) / 146097;
+  longlong doe = days - era * 146097;
+  longlong yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  longlong doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  longlong mp = (5 * doy + 2) / 153;
+  day = (uint)(doy - (153 * mp + 2) / 5 + 1);
+  month = (uint)(mp < 10 ? mp + 3 : mp - 9);
+  year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+}
+
+static time_t sdb_libc_mktime_date(uint year, uint month, uint day) {
+  struct tm tm_val;
+  tm_val.tm_sec = 0;
+  tm_val.tm_min = 0;
+  tm_val.tm_hour = 0;
+  tm_val.tm_mday = day;
+  tm_val.tm_mon = month - 1;
+  tm_val.tm_year = year - 1900;
+  tm_val.tm_wday = 0;
+  tm_val.tm_yday = 0;
+  tm_val.tm_isdst = 0;
+  return mktime(&tm_val);
+}
+
+/*
+  Get the cached offset of the year, resolving it by libc the first time.
+  The offset is only cached when every local midnight of the year has it and
+  localtime_r() maps each of them back to the same date.
+*/
+static int32 sdb_get_year_offset(uint year) {
+  int32 entry = my_atomic_load32(&sdb_year_offsets[year]);
+  if (SDB_YEAR_OFFSET_UNKNOWN != entry) {
+    return entry;
+  }
+
+  longlong first_day = sdb_days_from_civil(year, 1, 1);
+  longlong last_day = sdb_days_from_civil(year, 12, 31);
+  longlong offset =
+      (longlong)sdb_libc_mktime_date(year, 1, 1) - first_day * SDB_SECS_PER_DAY;
+  entry = (int32)(offset * 2 + 1);
+  for (longlong days = first_day; days <= last_day; ++days) {
+    longlong y = 0;
+    uint m = 0, d = 0;
+    struct tm tm_val;
+    time_t sec = 0;
+    sdb_civil_from_days(days, y, m, d);
+    sec = sdb_libc_mktime_date((uint)y, m, d);
+    if ((longlong)sec != days * SDB_SECS_PER_DAY + offset ||
+        NULL == localtime_r(&sec, &tm_val) || tm_val.tm_year + 1900 != y ||
+        tm_val.tm_mon + 1 != (int)m || tm_val.tm_mday != (int)d) {
+      entry = SDB_YEAR_OFFSET_NONUNIFORM;
+      break;
+    }
+  }
+  // Concurrent resolvers compute the same value, so a plain store is enough.
+  my_atomic_store32(&sdb_year_offsets[year], entry);
+  return entry;
+}
+
+time_t sdb_mktime_date(uint year, uint month, uint day) {
+  if (year >= SDB_MIN_CACHED_YEAR && year <= SDB_MAX_CACHED_YEAR &&
+      month >= 1 && month <= 12 && day >= 1 && day <= 31) {
+    int32 entry = sdb_get_year_offset(year);
+    if (SDB_YEAR_OFFSET_NONUNIFORM != entry) {
+      longlong offset = (entry - 1) / 2;
+      return (time_t)(sdb_days_from_civil(year, month, day) * SDB_SECS_PER_DAY +
+                      offset);
+    }
+  }
+  return sdb_libc_mktime_date(year, month, day);
+}
+
+void sdb_localtime_date(time_t sec, uint &year, uint &month, uint &day) {
+  struct tm tm_val;
+  longlong days = (longlong)sec / SDB_SECS_PER_DAY;
+  if ((longlong)sec % SDB_SECS_PER_DAY < 0) {
+    --days;
+  }
+
+  // The date stored is a local midnight, which is at most one day away from
+  // the UTC date of it.
+  for (longlong candidate = days - 1; candidate <= days + 1; ++candidate) {
+    longlong y = 0;
+    uint m = 0, d = 0;
+    sdb_civil_from_days(candidate, y, m, d);
+    if (y < SDB_MIN_CACHED_YEAR || y > SDB_MAX_CACHED_YEAR) {
+      continue;
+    }
+    int32 entry = sdb_get_year_offset((uint)y);
+    if (SDB_YEAR_OFFSET_NONUNIFORM != entry &&
+        candidate * SDB_SECS_PER_DAY + (entry - 1) / 2 == (longlong)sec) {
+      year = (uint)y;
+      month = m;
+      day = d;
+      return;
+    }
+  }
+
+  // not a local midnight, or offset not cached
+  localtime_r(&sec, &tm_val);
+  year = tm_val.tm_year + 1900;
+  month = tm_val.tm_mon + 1;
+  day = tm_val.tm_mday;
+}
+
+int sdb_parse_comment_options(const char *comment, bson::BSONObj &options) {
+  int rc = SDB_ERR_OK;
+  const char *sdb_cmt_pos = NULL;
+
+  options = SDB_EMPTY_BSON;
+  if (NULL == comment ||
+      (sdb_cmt_pos = strstr(comment, SDB_COMMENT)) == NULL) {
+    goto done;
+  }
+
+  sdb_cmt_pos += strlen(SDB_COMMENT);
+  while (*sdb_cmt_pos != '\0' && my_isspace(&SDB_CHARSET, *sdb_cmt_pos)) {
+    sdb_cmt_pos++;
+  }
+
+  if (*sdb_cmt_pos != ':') {
+    rc = SDB_ERR_INVALID_ARG;
+    goto error;
+  }
+
+  sdb_cmt_pos += 1;
+  while (*sdb_cmt_pos != '\0' && my_isspace(&SDB_CHARSET, *sdb_cmt_pos)) {
+    sdb_cmt_pos++;
+  }
+
+  rc = bson::fromjson(sdb_cmt_pos, options);
+  if (0 != rc) {
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+int sdb_get_datetime_format(const bson::BSONObj &options, bool &as_int64) {
+  int rc = SDB_ERR_OK;
+  bson::BSONElement elem = options.getField(SDB_DATETIME_FORMAT);
+
+  as_int64 = false;
+  if (bson::EOO == elem.type()) {
+    goto done;
+  }
+  if (bson::String != elem.type()) {
+    rc = SDB_ERR_INVALID_ARG;
+    goto error;
+  }
+  if (0 == strcmp(elem.valuestr(), "int64")) {
+    as_int64 = true;
+  } else if (0 != strcmp(elem.valuestr(), "string")) {
+    rc = SDB_ERR_INVALID_ARG;
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+bool sdb_is_datetime_as_int64(const char *comment) {
+  bson::BSONObj options;
+  bool as_int64 = false;
+
+  // Most tables have no such option, so avoid parsing the comment.
+  if (NULL == comment || NULL == strstr(comment, SDB_DATETIME_FORMAT)) {
+    return false;
+  }
+  if (0 != sdb_parse_comment_options(comment, options) ||
+      0 != sdb_get_datetime_format(options, as_int64)) {
+    return false;
+  }
+  return as_int64;
+}
+
+int sdb_get_lob_threshold(const bson::BSONObj &options, ulonglong &threshold) {
+  int rc = SDB_ERR_OK;
+  bson::BSONElement elem = options.getField(SDB_LOB_THRESHOLD);
+
+  threshold = 0;
+  if (bson::EOO == elem.type()) {
+    goto done;
+  }
+  if (!elem.isNumber() || elem.numberLong() < 0) {
+    rc = SDB_ERR_INVALID_ARG;
+    goto error;
+  }
+  threshold = (ulonglong)elem.numberLong();
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+ulonglong sdb_get_lob_threshold(const char *comment) {
+  bson::BSONObj options;
+  ulonglong threshold = 0;
+
+  if (NULL == comment || NULL == strstr(comment, SDB_LOB_THRESHOLD)) {
+    return 0;
+  }
+  if (0 != sdb_parse_comment_options(comment, options) ||
+      0 != sdb_get_lob_threshold(options, threshold)) {
+    return 0;
+  }
+  return threshold;
+}
+
+int sdb_get_sharding_options(const bson::BSONObj &options,
+                             bson::BSONObj &sharding_key, bool &is_hash,
+                             int &partition) {
+  int rc = SDB_ERR_OK;
+  bson::BSONElement elem;
+
+  sharding_key = SDB_EMPTY_BSON;
+  is_hash = false;
+  partition = 0;
+
+  elem = options.getField(SDB_SHARDING_KEY);
+  if (bson::Object == elem.type()) {
+    bson::BSONObjIterator it(elem.embeddedObject());
+    while (it.more()) {
+      if (!it.next().isNumber()) {
+        rc = SDB_ERR_INVALID_ARG;
+        goto error;
+      }
+    }
+    sharding_key = elem.embeddedObject().copy();
+  } else if (bson::EOO != elem.type()) {
+    rc = SDB_ERR_INVALID_ARG;
+    goto error;
+  }
+
+  elem = options.getField(SDB_SHARDING_TYPE);
+  if (bson::String == elem.type()) {
+    if (0 == strcmp(elem.valuestr(), "hash")) {
+      is_hash = true;
+    } else if (0 != strcmp(elem.valuestr(), "range")) {
+      rc = SDB_ERR_INVALID_ARG;
+      goto error;
+    }
+  } else if (bson::EOO != elem.type()) {
+    rc = SDB_ERR_INVALID_ARG;
+    goto error;
+  }
+
+  elem = options.getField(SDB_PARTITION);
+  if (bson::EOO != elem.type()) {
+    longlong value = elem.isNumber() ? elem.numberLong() : 0;
+    // Only hash sharding has partitions.
+    if (!is_hash || value < SDB_PARTITION_MIN || value > SDB_PARTITION_MAX ||
+        0 != (value & (value - 1))) {
+      rc = SDB_ERR_INVALID_ARG;
+      goto error;
+    }
+    partition = (int)value;
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+void sdb_build_oid_in_cond(const std::vector<bson::OID> &oids,
+                           bson::BSONObj &cond) {
+  bson::BSONObjBuilder cond_builder;
+  bson::BSONObjBuilder sub_builder(cond_builder.subobjStart(SDB_OID_FIELD));
+  bson::BSONArrayBuilder arr_builder(sub_builder.subarrayStart("$in"));
+  for (std::vector<bson::OID>::const_iterator it = oids.begin();
+       it != oids.end(); ++it) {
+    arr_builder.append(*it);
+  }
+  arr_builder.doneFast();
+  sub_builder.doneFast();
+  cond = cond_builder.obj();
+}
+
+/*
+  Value of BSON NumberDecimal in SequoiaDB, all in little endian:
+    int32 size | int32 typemod | int16 sign and dscale | int16 weight |
+    int16 digits[] in base 10000, the first one is of weight
+*/
+static const int SDB_DECIMAL_HEADER_SIZE = 12;
+static const uint SDB_DECIMAL_SIGN_MASK = 0xC000;
+static const uint SDB_DECIMAL_POS = 0x0000;
+static const uint SDB_DECIMAL_NEG = 0x4000;
+static const uint SDB_DECIMAL_DSCALE_MASK = 0x3FFF;
+static const int SDB_DECIMAL_DEFAULT_TYPEMOD = -1;
+static const int SDB_DECIMAL_NBASE = 10000;
+static const int SDB_DECIMAL_DIGITS = 4;  // decimal digits per base digit
+static const int SDB_DECIMAL_WORD_DIGITS = 9;  // decimal digits per dec1
+static const int SDB_DECIMAL_MAX_DIGITS =
+    DECIMAL_BUFF_LENGTH * SDB_DECIMAL_WORD_DIGITS + 2 * SDB_DECIMAL_DIGITS;
+
+static const int32 SDB_POWERS_10[SDB_DECIMAL_WORD_DIGITS + 1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+    1000000000};
+
+int sdb_decimal_to_bson_value(const decimal_t *dec, char *value, int &size) {
+  int rc = SDB_ERR_OK;
+  // decimal digits aligned to base 10000 on both sides of the point
+  uchar digits[SDB_DECIMAL_MAX_DIGITS];
+  int int_words = (dec->intg + SDB_DECIMAL_WORD_DIGITS - 1) /
+                  SDB_DECIMAL_WORD_DIGITS;
+  int frac_words = (dec->frac + SDB_DECIMAL_WORD_DIGITS - 1) /
+                   SDB_DECIMAL_WORD_DIGITS;
+  int int_pad = (SDB_DECIMAL_DIGITS - dec->intg % SDB_DECIMAL_DIGITS) %
+                SDB_DECIMAL_DIGITS;
+  int frac_len = (dec->frac + SDB_DECIMAL_DIGITS - 1) / SDB_DECIMAL_DIGITS *
+                 SDB_DECIMAL_DIGITS;
+  int n = 0;
+  int first = 0;
+  int last = 0;
+  int ndigits = 0;
+  int weight = 0;
+  bool is_zero = true;
+  char *pos = NULL;
+
+  if (int_pad + dec->intg + frac_len > SDB_DECIMAL_MAX_DIGITS ||
+      int_words + frac_words > dec->len) {
+    rc = SDB_ERR_INVALID_ARG;
+    goto error;
+  }
+
+  memset(digits, 0, int_pad);
+  n = int_pad;
+  for (int i = 0; i < int_words; ++i) {
+    int word_digits = (0 == i) ? dec->intg - (int_words - 1) *
+                                                 SDB_DECIMAL_WORD_DIGITS
+                               : SDB_DECIMAL_WORD_DIGITS;
+    int32 word = dec->buf[i];
+    for (int j = word_digits - 1; j >= 0; --j) {
+      digits[n++] = (uchar)(word / SDB_POWERS_10[j] % 10);
+    }
+  }
+  for (int i = 0; i < frac_words; ++i) {
+    int32 word = dec->buf[int_words + i];
+    for (int j = SDB_DECIMAL_WORD_DIGITS - 1; j >= 0; --j) {
+      if (n - int_pad - dec->intg >= dec->frac) {
+        break;
+      }
+      digits[n++] = (uchar)(word / SDB_POWERS_10[j] % 10);
+    }
+  }
+  memset(digits + n, 0, int_pad + dec->intg + frac_len - n);
+  n = int_pad + dec->intg + frac_len;
+
+  // strip the leading and trailing zero base digits
+  ndigits = n / SDB_DECIMAL_DIGITS;
+  weight = (int_pad + dec->intg) / SDB_DECIMAL_DIGITS - 1;
+  first = 0;
+  last = ndigits - 1;
+  for (int i = 0; i < n; ++i) {
+    if (digits[i]) {
+      is_zero = false;
+      break;
+    }
+  }
+  if (is_zero) {
+    ndigits = 0;
+    weight = 0;
+  } else {
+    for (;; ++first, --weight) {
+      const uchar *d = digits + first * SDB_DECIMAL_DIGITS;
+      if (d[0] || d[1] || d[2] || d[3]) {
+        break;
+      }
+    }
+    for (;; --last) {
+      const uchar *d = digits + last * SDB_DECIMAL_DIGITS;
+      if (d[0] || d[1] || d[2] || d[3]) {
+        break;
+      }
+    }
+    ndigits = last - first + 1;
+  }
+
+  size = SDB_DECIMAL_HEADER_SIZE + ndigits * 2;
+  if (size > SDB_DECIMAL_VALUE_MAX_SIZE) {
+    rc = SDB_ERR_INVALID_ARG;
+    goto error;
+  }
+
+  pos = value;
+  int4store(pos, (uint32)size);
+  pos += 4;
+  int4store(pos, (uint32)SDB_DECIMAL_DEFAULT_TYPEMOD);
+  pos += 4;
+  int2store(pos, (uint16)(((dec->sign && !is_zero) ? SDB_DECIMAL_NEG
+                                                   : SDB_DECIMAL_POS) |
+                          (dec->frac & SDB_DECIMAL_DSCALE_MASK)));
+  pos += 2;
+  int2store(pos, (uint16)(int16)weight);
+  pos += 2;
+  for (int i = first; i < first + ndigits; ++i) {
+    const uchar *d = digits + i * SDB_DECIMAL_DIGITS;
+    int2store(pos, (uint16)(d[0] * 1000 + d[1] * 100 + d[2] * 10 + d[3]));
+    pos += 2;
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+int sdb_decimal_to_bson(const decimal_t *dec, bson::bsonDecimal &bson_dec) {
+  int rc = SDB_ERR_OK;
+  char value[SDB_DECIMAL_VALUE_MAX_SIZE];
+  int size = 0;
+
+  rc = sdb_decimal_to_bson_value(dec, value, size);
+  if (SDB_ERR_OK != rc) {
+    goto error;
+  }
+
+  rc = bson_dec.fromBsonValue(value);
+  if (0 != rc) {
+    rc = SDB_ERR_INVALID_ARG;
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+int sdb_bson_value_to_decimal(const char *value, decimal_t *dec) {
+  int rc = SDB_ERR_OK;
+  uchar digits[SDB_DECIMAL_MAX_DIGITS];
+  int size = sint4korr(value);
+  uint sign_dscale = uint2korr(value + 8);
+  int weight = sint2korr(value + 10);
+  const char *base_digits = value + SDB_DECIMAL_HEADER_SIZE;
+  int ndigits = (size - SDB_DECIMAL_HEADER_SIZE) / 2;
+  uint sign = sign_dscale & SDB_DECIMAL_SIGN_MASK;
+  int dscale = sign_dscale & SDB_DECIMAL_DSCALE_MASK;
+  int int_len = weight >= 0 ? (weight + 1) * SDB_DECIMAL_DIGITS : 0;
+  int frac_len = (dscale + SDB_DECIMAL_DIGITS - 1) / SDB_DECIMAL_DIGITS *
+                 SDB_DECIMAL_DIGITS;
+  int n = 0;
+  int start = 0;
+  int intg = 0;
+  int int_words = 0;
+  int frac_words = 0;
+  dec1 *buf = dec->buf;
+
+  if ((SDB_DECIMAL_POS != sign && SDB_DECIMAL_NEG != sign) ||
+      size < SDB_DECIMAL_HEADER_SIZE ||
+      int_len + frac_len > SDB_DECIMAL_MAX_DIGITS) {
+    // NaN, MIN, MAX or too large to convert
+    rc = SDB_ERR_INVALID_ARG;
+    goto error;
+  }
+
+  // expand to decimal digits, integer part first
+  for (int e = (weight >= 0 ? weight : -1);
+       e >= -(frac_len / SDB_DECIMAL_DIGITS); --e) {
+    int i = weight - e;
+    uint digit = (i >= 0 && i < ndigits) ? uint2korr(base_digits + i * 2) : 0;
+    if (digit >= (uint)SDB_DECIMAL_NBASE) {
+      rc = SDB_ERR_INVALID_ARG;
+      goto error;
+    }
+    digits[n++] = (uchar)(digit / 1000);
+    digits[n++] = (uchar)(digit / 100 % 10);
+    digits[n++] = (uchar)(digit / 10 % 10);
+    digits[n++] = (uchar)(digit % 10);
+  }
+  // the digits beyond dscale must be zero
+  if (weight < -(frac_len / SDB_DECIMAL_DIGITS) && ndigits > 0) {
+    rc = SDB_ERR_INVALID_ARG;
+    goto error;
+  }
+  for (int i = weight + frac_len / SDB_DECIMAL_DIGITS + 1; i < ndigits; ++i) {
+    if (0 != uint2korr(base_digits + i * 2)) {
+      rc = SDB_ERR_INVALID_ARG;
+      goto error;
+    }
+  }
+  for (int i = int_len + dscale; i < n; ++i) {
+    if (digits[i]) {
+      rc = SDB_ERR_INVALID_ARG;
+      goto error;
+    }
+  }
+
+  // skip the leading zeros of integer part
+  while (start < int_len && 0 == digits[start]) {
+    ++start;
+  }
+  intg = int_len - start;
+  int_words = (intg + SDB_DECIMAL_WORD_DIGITS - 1) / SDB_DECIMAL_WORD_DIGITS;
+  frac_words = (dscale + SDB_DECIMAL_WORD_DIGITS - 1) / SDB_DECIMAL_WORD_DIGITS;
+  if (0 == int_words && 0 == frac_words) {
+    // zero
+    intg = 1;
+    int_words = 1;
+  }
+  if (int_words + frac_words > dec->len) {
+    rc = SDB_ERR_INVALID_ARG;
+    goto error;
+  }
+
+  n = start;
+  for (int i = 0; i < int_words; ++i) {
+    int word_digits = (0 == i) ? intg - (int_words - 1) *
+                                            SDB_DECIMAL_WORD_DIGITS
+                               : SDB_DECIMAL_WORD_DIGITS;
+    dec1 word = 0;
+    for (int j = 0; j < word_digits; ++j) {
+      word = word * 10 + (n < int_len ? digits[n] : 0);
+      ++n;
+    }
+    *buf++ = word;
+  }
+  n = int_len;
+  for (int i = 0; i < frac_words; ++i) {
+    dec1 word = 0;
+    for (int j = 0; j < SDB_DECIMAL_WORD_DIGITS; ++j) {
+      word = word * 10 + (n < int_len + dscale ? digits[n] : 0);
+      ++n;
+    }
+    *buf++ = word;
+  }
+
+  dec->intg = intg;
+  dec->frac = dscale;
+  dec->sign = (SDB_DECIMAL_NEG == sign);
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+static bool sdb_is_valid_field_name(const std::string &name) {
+  return !name.empty() && '$' != name[0] &&
+         std::string::npos == name.find('.') &&
+         std::string::npos == name.find('\0');
+}
+
+int sdb_json_to_bson(const Json_wrapper &json, const char *name,
+                     bson::BSONObjBuilder &builder) {
+  int rc = SDB_ERR_OK;
+
+  switch (json.type()) {
+    case J_NULL: {
+      builder.appendNull(name);
+      break;
+    }
+    case J_INT: {
+      longlong value = json.get_int();
+      if (value > INT_MAX32 || value < INT_MIN32) {
+        builder.append(name, (long long)value);
+      } else {
+        builder.append(name, (int)value);
+      }
+      break;
+    }
+    case J_DOUBLE: {
+      builder.append(name, json.get_double());
+      break;
+    }
+    case J_DECIMAL: {
+      my_decimal dec_val;
+      bson::bsonDecimal bson_dec;
+      if (json.get_decimal_data(&dec_val)) {
+        rc = SDB_ERR_INVALID_ARG;
+        goto error;
+      }
+      rc = sdb_decimal_to_bson(&dec_val, bson_dec);
+      if (0 != rc) {
+        rc = SDB_ERR_TYPE_UNSUPPORTED;
+        goto error;
+      }
+      builder.append(name, bson_dec);
+      break;
+    }
+    case J_STRING: {
+      builder.appendStrWithNoTerminating(name, json.get_data(),
+                                         (int)json.get_data_length());
+      break;
+    }
+    case J_BOOLEAN: {
+      builder.appendBool(name, json.get_boolean());
+      break;
+    }
+    case J_OBJECT: {
+      bson::BSONObjBuilder sub_builder(builder.subobjStart(name));
+      for (Json_wrapper_object_iterator it = json.object_iterator();
+           !it.empty(); it.next()) {
+        std::pair<const std::string, Json_wrapper> member = it.elt();
+        if (!sdb_is_valid_field_name(member.first)) {
+          rc = SDB_ERR_TYPE_UNSUPPORTED;
+          goto error;
+        }
+        rc = sdb_json_to_bson(member.second, member.first.c_str(),
+                              sub_builder);
+        if (0 != rc) {
+          goto error;
+        }
+      }
+      sub_builder.doneFast();
+      break;
+    }
+    case J_ARRAY: {
+      bson::BSONObjBuilder sub_builder(builder.subarrayStart(name));
+      for (size_t i = 0; i < json.length(); ++i) {
+        char index[MY_INT64_NUM_DECIMAL_DIGITS + 1];
+        snprintf(index, sizeof(index), "%u", (uint)i);
+        rc = sdb_json_to_bson(json[i], index, sub_builder);
+        if (0 != rc) {
+          goto error;
+        }
+      }
+      sub_builder.doneFast();
+      break;
+    }
+    default: {
+      // J_UINT, J_DATE, J_TIME, J_DATETIME, J_TIMESTAMP, J_OPAQUE
+      rc = SDB_ERR_TYPE_UNSUPPORTED;
+      goto error;
+    }
+  }
+
+done:
+  return rc;
+error:
+  goto done;
+}
+
+int sdb_bson_to_json(const bson::BSONElement &elem, Json_dom *&dom) {
+  int rc = SDB_ERR_OK;
+
+  dom = NULL;
+  switch (elem.type()) {
+    case bson::jstNULL: {
+      dom = new (std::nothrow) Json_null();
+      break;
+    }
+    case bson::NumberInt:
+    case bson::NumberLong: {
+      dom = new (std::nothrow) Json_int(elem.numberLong());
+      break;
+    }
+    case bson::NumberDouble: {
+      dom = new (std::nothrow) Json_double(elem.numberDouble());
+      break;
+    }
+    case bson::NumberDecimal: {
+      my_decimal dec_val;
+      rc = sdb_bson_value_to_decimal(elem.value(), &dec_val);
+      if (0 != rc) {
+        goto error;
+      }
+      dom = new (std::nothrow) Json_decimal(dec_val);
+      break;
+    }
+    case bson::String: {
+      dom = new (std::nothrow)
+          Json_string(std::string(elem.valuestr(), elem.valuestrsize() - 1));
+      break;
+    }
+    case bson::Bool: {
+      dom = new (std::nothrow) Json_boolean(elem.boolean());
+      break;
+    }
+    case bson::Object: {
+      Json_object *object = new (std::nothrow) Json_object();
+      if (NULL == object) {
+        break;
+      }
+      dom = object;
+      bson::BSONObjIterator it(elem.embeddedObject());
+      while (it.more()) {
+        bson::BSONElement sub_elem = it.next();
+        Json_dom *member = NULL;
+        rc = sdb_bson_to_json(sub_elem, member);
+        if (0 != rc) {
+          goto error;
+        }
+        if (object->add_alias(sub_elem.fieldName(), member)) {
+          rc = HA_ERR_OUT_OF_MEM;
+          goto error;
+        }
+      }
+      break;
+    }
+    case bson::Array: {
+      Json_array *array = new (std::nothrow) Json_array();
+      if (NULL == array) {
+        break;
+      }
+      dom = array;
+      bson::BSONObjIterator it(elem.embeddedObject());
+      while (it.more()) {
+        Json_dom *value = NULL;
+        rc = sdb_bson_to_json(it.next(), value);
+        if (0 != rc) {
+          goto error;
+        }
+        if (array->append_alias(value)) {
+          rc = HA_ERR_OUT_OF_MEM;
+          goto error;
+        }
+      }
+      break;
+    }
+    default: {
+      rc = SDB_ERR_TYPE_UNSUPPORTED;
+      goto error;
+    }
+  }
+
+  if (NULL == dom) {
+    rc = HA_ERR_OUT_OF_MEM;
+    goto error;
+  }
+
+done:
+  return rc;
+error:
+  delete dom;
+  dom = NULL;
+  goto done;
+}
+
 Sdb_encryption::Sdb_encryption() {
   my_rand_buffer(m_key, KEY_LEN);
 }
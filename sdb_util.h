@@ -19,6 +19,8 @@
 
 #include <sql_class.h>
 #include <my_aes.h>
+#include <my_decimal.h>
+#include <vector>
 #include <client.hpp>
 #include "sdb_errcode.h"
 
@@ -34,13 +36,112 @@ int sdb_rebuild_db_name_of_temp_table(char *db_name, int db_name_max_size);
 
 bool sdb_is_tmp_table(const char *path, const char *table_name);
 
+/*
+  Convert src_str to dst_charset. If the bytes need no conversion, dst_str
+  refers to the buffer of src_str without copying.
+*/
 int sdb_convert_charset(const String &src_str, String &dst_str,
                         const CHARSET_INFO *dst_charset);
 
+bool sdb_is_ascii(const char *data, size_t length);
+
+// Whether any string in src_charset has the same bytes in dst_charset.
+bool sdb_is_same_encoding(const CHARSET_INFO *src_charset,
+                          const CHARSET_INFO *dst_charset);
+
+/*
+  Whether the bytes in src_charset are the same in dst_charset, so the
+  conversion can be skipped. Besides the same encoding, that is the case
+  for pure ASCII data in ASCII-based charsets.
+*/
+bool sdb_is_same_in_charset(const char *data, size_t length,
+                            const CHARSET_INFO *src_charset,
+                            const CHARSET_INFO *dst_charset);
+
 bool sdb_field_is_floating(enum_field_types type);
 
 bool sdb_field_is_date_time(enum_field_types type);
 
+/*
+  Same as mktime() of the local midnight with tm_isdst = 0, which is how DATE
+  is stored, but computed arithmetically from a cached per-year UTC offset of
+  the server time zone, so no libc time function is called on the hot path.
+*/
+time_t sdb_mktime_date(uint year, uint month, uint day);
+
+// Inverse of sdb_mktime_date(), same as the date part of localtime_r().
+void sdb_localtime_date(time_t sec, uint &year, uint &month, uint &day);
+
+/*
+  Parse the options in table comment, which is like 'sequoiadb: { ... }'.
+  options is empty if the comment has no such part.
+*/
+int sdb_parse_comment_options(const char *comment, bson::BSONObj &options);
+
+/*
+  Get the storage format of DATETIME from the comment options. DATETIME is
+  stored as string by default, or as packed int64 with microseconds if
+  'datetime_format: "int64"' is specified.
+*/
+int sdb_get_datetime_format(const bson::BSONObj &options, bool &as_int64);
+
+// Same as above but from the comment, which has been validated when created.
+bool sdb_is_datetime_as_int64(const char *comment);
+
+/*
+  Get the size threshold of LOB from the comment options. BLOB and TEXT
+  values of at least the size are stored in LOBs instead of the record if
+  'lob_threshold: <bytes>' is specified, 0 means never.
+*/
+int sdb_get_lob_threshold(const bson::BSONObj &options, ulonglong &threshold);
+
+// Same as above but from the comment, which has been validated when created.
+ulonglong sdb_get_lob_threshold(const char *comment);
+
+/*
+  Get the sharding options from the comment options:
+    'sharding_key: {<field>: 1, ...}' shards by the fields instead of the
+    primary key or the first unique key,
+    'sharding_type: "hash"' shards by the hash of the sharding key instead of
+    its ranges, which spreads the inserts of increasing keys to all groups,
+    'partition: <n>' is the number of hash partitions, a power of 2.
+  sharding_key is empty and partition is 0 if not specified.
+*/
+int sdb_get_sharding_options(const bson::BSONObj &options,
+                             bson::BSONObj &sharding_key, bool &is_hash,
+                             int &partition);
+
+// Build the condition {_id: {$in: [oids]}}.
+void sdb_build_oid_in_cond(const std::vector<bson::OID> &oids,
+                           bson::BSONObj &cond);
+
+#define SDB_DECIMAL_VALUE_MAX_SIZE 128
+
+/*
+  Convert between MySQL decimal_t (base 1e9 words) and the BSON value of
+  SequoiaDB decimal (base 10000 digits) directly, without formatting and
+  parsing strings.
+*/
+int sdb_decimal_to_bson_value(const decimal_t *dec, char *value, int &size);
+
+int sdb_decimal_to_bson(const decimal_t *dec, bson::bsonDecimal &bson_dec);
+
+int sdb_bson_value_to_decimal(const char *value, decimal_t *dec);
+
+class Json_wrapper;
+class Json_dom;
+
+/*
+  Convert JSON to native BSON, so that SequoiaDB can filter it by path. The
+  JSON which BSON can't keep exactly, like unsigned integer, temporal value
+  or the key which isn't a valid field name, is SDB_ERR_TYPE_UNSUPPORTED.
+*/
+int sdb_json_to_bson(const Json_wrapper &json, const char *name,
+                     bson::BSONObjBuilder &builder);
+
+// Inverse of above. The DOM is allocated and owned by the caller.
+int sdb_bson_to_json(const bson::BSONElement &elem, Json_dom *&dom);
+
 class Sdb_encryption {
   static const uint KEY_LEN = 32;
   static const enum my_aes_opmode AES_OPMODE = my_aes_128_ecb;